@@ -0,0 +1,51 @@
+//
+// Arena.cpp
+// ConstraintBasedMotionEdit
+//
+// Block management for Arena.
+//
+
+#include "Arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Smallest block taken from the heap; larger requests get a block of their own size
+static constexpr size_t k_minBlock = 64 * 1024;
+
+void Arena::addBlock(size_t bytes) {
+    // new[] only guarantees max_align_t; over-allocate to align the start
+    Block block;
+    block.size = std::max(alignedSize(bytes), k_minBlock) + k_align;
+    block.data.reset(new unsigned char[block.size]);
+    m_blocks.push_back(std::move(block));
+
+    const size_t misalign = reinterpret_cast<uintptr_t>(m_blocks.back().data.get()) & (k_align - 1);
+    m_used = misalign ? k_align - misalign : 0;
+    m_held += m_blocks.back().size;
+    m_stats.blocks++;
+    m_stats.peakBytes = std::max(m_stats.peakBytes, m_held);
+}
+
+void Arena::reserve(size_t bytes) {
+    if (!m_blocks.empty() && m_blocks.back().size - m_used >= bytes) return;
+    addBlock(bytes);
+}
+
+void* Arena::allocate(size_t bytes) {
+    bytes = alignedSize(std::max<size_t>(bytes, 1));
+    if (m_blocks.empty() || m_blocks.back().size - m_used < bytes) addBlock(bytes);
+
+    void* p = m_blocks.back().data.get() + m_used;
+    m_used += bytes;
+    m_stats.allocations++;
+    m_stats.bytes += bytes;
+    return p;
+}
+
+void Arena::release() {
+    std::vector<Block>().swap(m_blocks);
+    m_used  = 0;
+    m_held  = 0;
+    m_stats = Stats();
+}
@@ -0,0 +1,59 @@
+//
+// Arena.h
+// ConstraintBasedMotionEdit
+//
+// Bump allocator for data that lives exactly as long as one clip. Memory is
+// taken from the heap in blocks; allocations are carved off the current
+// block and never freed one by one. release() returns every block at once.
+// Only for trivially destructible data (planes of floats, ints, PODs).
+//
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Arena {
+public:
+    // Since the last release()
+    struct Stats {
+        size_t allocations = 0;   // allocate() calls
+        size_t blocks      = 0;   // heap allocations behind them
+        size_t bytes       = 0;   // handed out, including alignment padding
+        size_t peakBytes   = 0;   // most heap memory held at once
+    };
+
+    static constexpr size_t k_align = 64;   // cache line; plenty for SIMD loads
+
+    Arena() = default;
+    Arena(Arena&&) noexcept            = default;
+    Arena& operator=(Arena&&) noexcept = default;
+    Arena(const Arena&)                = delete;
+    Arena& operator=(const Arena&)     = delete;
+
+    // Makes the next block hold at least bytes more, so a caller that knows
+    // its total up front (summed with alignedSize) gets one heap allocation.
+    void  reserve(size_t bytes);
+    static size_t alignedSize(size_t bytes) { return (bytes + k_align - 1) & ~(k_align - 1); }
+    void* allocate(size_t bytes);
+    // n uninitialized elements; T must be trivially destructible
+    template <class T>
+    T* allocate(size_t n) { return static_cast<T*>(allocate(n * sizeof(T))); }
+
+    void         release();
+    const Stats& stats() const { return m_stats; }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t                           size = 0;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t             m_used = 0;    // bytes used in m_blocks.back()
+    size_t             m_held = 0;    // sum of block sizes
+    Stats              m_stats;
+
+    void addBlock(size_t bytes);
+};
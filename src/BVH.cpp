@@ -3,17 +3,24 @@
 // ConstraintBasedMotionEdit
 //
 // BVH file loader: parses HIERARCHY and MOTION sections,
-// converts Euler angles to quaternions, and applies pose to Body.
+// converts Euler angles to quaternions, and writes poses into a MotionClip.
 //
 
 #include "BVH.h"
+#include "BVHText.h"
+#include "MappedFile.h"
 #include "ShaderUtils.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <cstring>
 #include <iostream>
-
-static constexpr float k_pi = 3.14159265f;
+#include <string_view>
+#include <vector>
 
 // ---------------------------------------------------------------------------
 // Constructor / Destructor
@@ -33,15 +40,19 @@ BVH::~BVH() { Clear(); }
 // ---------------------------------------------------------------------------
 
 void BVH::Clear() {
-    for (auto* c : channels) delete c;
-    for (auto* j : joints)   delete j;
-
     channels.clear();
     joints.clear();
-    joint_index.clear();
+    joint_order.clear();
     motion.clear();
+    motion_data = nullptr;
+    motion_map.reset();
+    stream.reset();
+    compressed = CompressedMotion();
+    rotation_tracks.clear();
+    tracks_pending = false;
 
     is_load_success = false;
+    load_stats      = LoadStats();
     file_name       = "";
     motion_name     = "";
     num_channel     = 0;
@@ -49,11 +60,211 @@ void BVH::Clear() {
     interval        = 0.0;
 }
 
+// Copies mapped or streamed motion into 'motion' so it can be modified.
+void BVH::DetachMotion() {
+    if (stream) {
+        motion.assign((size_t)num_frame * num_channel, 0.0);
+        stream->decodeAll(motion.data());
+        stream.reset();
+    }
+    else if (motion_map) {
+        motion.assign(motion_data, motion_data + (size_t)num_frame * num_channel);
+        motion_map.reset();
+    }
+    motion_data = motion.data();
+}
+
+int BVH::FindJoint(std::string_view name) const {
+    auto it = std::lower_bound(joint_order.begin(), joint_order.end(), name,
+                               [this](int j, std::string_view n) { return joints[j].name < n; });
+    return it != joint_order.end() && joints[*it].name == name ? *it : -1;
+}
+
+bool BVH::FinishSkeleton() {
+    const int numJoints = (int)joints.size();
+    if (numJoints == 0) return false;
+
+    for (int i = 0; i < numJoints; i++) {
+        const int p = joints[i].parent;
+        if ((i == 0) != (p < 0) || p >= i) return false;
+
+        // Depth-first order: the previous joint is p or one of its descendants
+        int a = i - 1;
+        while (a > p) a = joints[a].parent;
+        if (a != p) return false;
+
+        joints[i].subtree_end = i + 1;
+    }
+    for (int i = numJoints - 1; i > 0; i--) {
+        Joint& parent = joints[joints[i].parent];
+        parent.subtree_end = std::max(parent.subtree_end, joints[i].subtree_end);
+    }
+
+    for (auto& joint : joints) {
+        joint.num_rot = 0;
+        const Channel* ch = JointChannels(joint);
+        for (int i = 0; i < joint.num_channels && joint.num_rot < 3; i++) {
+            if (ch[i].type > Z_ROTATION) continue;
+            joint.rot_channel[joint.num_rot] = ch[i].index;
+            joint.rot_axis[joint.num_rot]    = (int)ch[i].type;
+            joint.num_rot++;
+        }
+        joint.rotation = euler::select(joint.rot_axis, joint.num_rot);
+    }
+
+    joint_order.resize(numJoints);
+    for (int i = 0; i < numJoints; i++) joint_order[i] = i;
+    std::stable_sort(joint_order.begin(), joint_order.end(),
+                     [this](int a, int b) { return joints[a].name < joints[b].name; });
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 // Load
 // ---------------------------------------------------------------------------
 
-void BVH::Load(const char* bvhFile) {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using bvhtext::isSep;
+using bvhtext::parseFrameLine;
+
+// Motion name is the file name without directory and extension.
+std::string motionNameFromPath(const char* bvhFile) {
+    const char* nameStart = bvhFile;
+    const char* nameEnd   = bvhFile + strlen(bvhFile);
+    if (auto* p = strrchr(bvhFile, '\\')) nameStart = p + 1;
+    else if (auto* p = strrchr(bvhFile, '/')) nameStart = p + 1;
+    if (auto* p = strrchr(bvhFile, '.')) nameEnd = p;
+    if (nameEnd < nameStart) nameEnd = bvhFile + strlen(bvhFile);
+    return std::string(nameStart, nameEnd);
+}
+
+// Returns the line starting at p (without '\n') and advances p past it.
+inline std::string_view nextLine(const char*& p, const char* end) {
+    const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+    const char* e  = nl ? nl : end;
+    std::string_view line(p, (size_t)(e - p));
+    p = nl ? nl + 1 : end;
+    return line;
+}
+
+// Pops the next separator-delimited token off the front of line.
+inline std::string_view nextToken(std::string_view& line) {
+    size_t b = 0;
+    while (b < line.size() && isSep(line[b])) b++;
+    size_t e = b;
+    while (e < line.size() && !isSep(line[e])) e++;
+    std::string_view tok = line.substr(b, e - b);
+    line.remove_prefix(e);
+    return tok;
+}
+
+// Header numbers (OFFSET, CHANNELS, Frames, Frame Time); false unless the
+// token starts with a number.
+template <class T>
+inline bool toNumber(std::string_view tok, T& out) {
+    return bvhtext::parseNumber(tok.data(), tok.data() + tok.size(), out) != nullptr;
+}
+
+// Below this many frames the MOTION block is parsed on the calling thread.
+constexpr int k_parallelMinFrames = 4096;
+
+// Parses consecutive frame lines starting at p into out[frame * numChannel],
+// beginning at firstFrame and stopping at numFrame or end.
+void parseFrameLines(const char* p, const char* end, double* out,
+                     int firstFrame, int numFrame, int numChannel) {
+    for (int i = firstFrame; i < numFrame && p < end; i++) {
+        const char* nl      = (const char*)memchr(p, '\n', (size_t)(end - p));
+        const char* lineEnd = nl ? nl : end;
+        parseFrameLine(p, lineEnd, out + (size_t)i * numChannel, numChannel);
+        p = nl ? nl + 1 : end;
+    }
+}
+
+// Number of lines in [p, end), counting an unterminated last line.
+int countLines(const char* p, const char* end) {
+    int n = 0;
+    while (p < end) {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        n++;
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return n;
+}
+
+// Parses the MOTION block across the shared pool. The block is cut into
+// newline-aligned chunks; a first pass counts lines per chunk, a prefix sum
+// gives each chunk its first frame, and a second pass parses every chunk into
+// its own rows of out. Each value is parsed exactly as in the serial path.
+void parseMotionParallel(const char* p, const char* end, double* out,
+                         int numFrame, int numChannel) {
+    ThreadPool& pool      = ThreadPool::shared();
+    const int   numChunks = pool.size() * 4;
+    const size_t bytes    = (size_t)(end - p);
+
+    std::vector<const char*> start(numChunks + 1);
+    start[0]         = p;
+    start[numChunks] = end;
+    for (int c = 1; c < numChunks; c++) {
+        const char* q  = std::max(p + bytes * c / numChunks, start[c - 1]);
+        const char* nl = (const char*)memchr(q, '\n', (size_t)(end - q));
+        start[c] = nl ? nl + 1 : end;
+    }
+
+    std::vector<int> firstFrame(numChunks + 1, 0);
+    pool.parallelFor(numChunks, 1, [&](int b, int e) {
+        for (int c = b; c < e; c++)
+            firstFrame[c + 1] = countLines(start[c], start[c + 1]);
+    });
+    for (int c = 0; c < numChunks; c++)
+        firstFrame[c + 1] += firstFrame[c];
+
+    pool.parallelFor(numChunks, 1, [&](int b, int e) {
+        for (int c = b; c < e; c++)
+            parseFrameLines(start[c], start[c + 1], out, firstFrame[c], numFrame, numChannel);
+    });
+}
+
+} // namespace
+
+void BVH::Load(const char* bvhFile, const BVHLoadOptions& options) {
+    auto t0 = Clock::now();
+
+    bool cached = options.useCache && LoadCache(bvhFile);
+    if (cached) {
+        file_name   = bvhFile;
+        motion_name = motionNameFromPath(bvhFile);
+    }
+    else {
+        const bool streaming = options.streamWindow > 0;
+        if (options.mapped || streaming) LoadMapped(bvhFile, options.parallel, options.streamWindow);
+        else                             LoadStream(bvhFile);
+        if (!is_load_success) return;
+        motion_data = motion.data();
+        if (options.useCache && !streaming) SaveCache(bvhFile);
+    }
+
+    tracks_pending  = options.quatTracks && options.streamWindow <= 0;
+    tracks_parallel = options.parallel;
+
+    load_stats.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    load_stats.mapped  = options.mapped || cached || stream;
+    load_stats.cached  = cached;
+
+    const char* mode = cached ? "cache" : stream ? "streaming" : options.mapped ? "mapped" : "stream";
+    if (options.verbose)
+        std::cout << "[BVH] Loaded: " << file_name
+                  << "  frames=" << num_frame
+                  << "  (" << mode << ", "
+                  << load_stats.BytesPerSec() / (1024.0 * 1024.0) << " MB/s, "
+                  << load_stats.FramesPerSec(num_frame) << " frames/s)\n";
+
+    if (options.compressKeyInterval > 0) Compress(options.compressKeyInterval);
+}
+
+void BVH::LoadStream(const char* bvhFile) {
     constexpr int k_bufLen = 1024 * 32;
 
     std::ifstream file(bvhFile, std::ios::in);
@@ -64,23 +275,16 @@ void BVH::Load(const char* bvhFile) {
 
     Clear();
 
-    // Derive motion name from file path
-    file_name = bvhFile;
-    const char* nameStart = bvhFile;
-    const char* nameEnd   = bvhFile + strlen(bvhFile);
-    if (auto* p = strrchr(bvhFile, '\\')) nameStart = p + 1;
-    else if (auto* p = strrchr(bvhFile, '/')) nameStart = p + 1;
-    if (auto* p = strrchr(bvhFile, '.')) nameEnd = p;
-    if (nameEnd < nameStart) nameEnd = bvhFile + strlen(bvhFile);
-    motion_name.assign(nameStart, nameEnd);
+    file_name   = bvhFile;
+    motion_name = motionNameFromPath(bvhFile);
 
     char   line[k_bufLen];
     char   sep[] = " :,\t\r";
     char*  tok       = nullptr;
-    Joint* joint     = nullptr;
-    Joint* new_joint = nullptr;
+    int    joint     = -1;
+    int    new_joint = -1;
 
-    std::vector<Joint*> stack;
+    std::vector<int> stack;
 
     // Parse HIERARCHY
     while (!file.eof()) {
@@ -100,56 +304,58 @@ void BVH::Load(const char* bvhFile) {
         }
 
         if (strcmp(tok, "ROOT") == 0 || strcmp(tok, "JOINT") == 0 || strcmp(tok, "End") == 0) {
-            new_joint = new Joint();
-            new_joint->index    = (int)joints.size();
-            new_joint->parent   = joint;
-            new_joint->has_site = (strcmp(tok, "End") == 0);
-            joints.push_back(new_joint);
-            if (joint) joint->children.push_back(new_joint);
+            new_joint = (int)joints.size();
+            Joint& nj        = joints.emplace_back();
+            nj.index         = new_joint;
+            nj.parent        = joint;
+            nj.channel_begin = (int)channels.size();
+            nj.has_site      = (strcmp(tok, "End") == 0);
 
             tok = strtok(nullptr, "");
             while (tok && *tok == ' ') tok++;
-            new_joint->name = tok ? tok : "";
-            joint_index[new_joint->name] = new_joint;
+            nj.name = tok ? tok : "";
             continue;
         }
 
-        if (strcmp(tok, "OFFSET") == 0 && joint) {
+        if (strcmp(tok, "OFFSET") == 0 && joint >= 0) {
             auto nextDouble = [&]() -> double {
                 tok = strtok(nullptr, sep);
                 return tok ? atof(tok) : 0.0;
             };
-            joint->offset[0] = nextDouble();
-            joint->offset[1] = nextDouble();
-            joint->offset[2] = nextDouble();
+            joints[joint].offset[0] = nextDouble();
+            joints[joint].offset[1] = nextDouble();
+            joints[joint].offset[2] = nextDouble();
             continue;
         }
 
-        if (strcmp(tok, "CHANNELS") == 0 && joint) {
+        if (strcmp(tok, "CHANNELS") == 0 && joint >= 0) {
             tok = strtok(nullptr, sep);
             int count = tok ? atoi(tok) : 0;
-            joint->channels.resize(count);
+            joints[joint].channel_begin = (int)channels.size();
+            joints[joint].num_channels  = count;
             for (int i = 0; i < count; i++) {
-                auto* ch  = new Channel();
-                ch->joint = joint;
-                ch->index = (int)channels.size();
-                channels.push_back(ch);
-                joint->channels[i] = ch;
+                Channel& ch = channels.emplace_back();
+                ch.joint = joint;
+                ch.index = (int)channels.size() - 1;
 
                 tok = strtok(nullptr, sep);
-                if      (!tok)                            ch->type = X_ROTATION;
-                else if (strcmp(tok, "Xrotation") == 0)  ch->type = X_ROTATION;
-                else if (strcmp(tok, "Yrotation") == 0)  ch->type = Y_ROTATION;
-                else if (strcmp(tok, "Zrotation") == 0)  ch->type = Z_ROTATION;
-                else if (strcmp(tok, "Xposition") == 0)  ch->type = X_POSITION;
-                else if (strcmp(tok, "Yposition") == 0)  ch->type = Y_POSITION;
-                else                                      ch->type = Z_POSITION;
+                if      (!tok)                            ch.type = X_ROTATION;
+                else if (strcmp(tok, "Xrotation") == 0)  ch.type = X_ROTATION;
+                else if (strcmp(tok, "Yrotation") == 0)  ch.type = Y_ROTATION;
+                else if (strcmp(tok, "Zrotation") == 0)  ch.type = Z_ROTATION;
+                else if (strcmp(tok, "Xposition") == 0)  ch.type = X_POSITION;
+                else if (strcmp(tok, "Yposition") == 0)  ch.type = Y_POSITION;
+                else                                      ch.type = Z_POSITION;
             }
             continue;
         }
 
         if (strcmp(tok, "MOTION") == 0) break;
     }
+    if (!FinishSkeleton()) {
+        std::cerr << "[BVH] Unsupported hierarchy: " << bvhFile << "\n";
+        return;
+    }
 
     // Parse MOTION header
     file.getline(line, k_bufLen);
@@ -179,60 +385,275 @@ void BVH::Load(const char* bvhFile) {
         }
     }
 
+    file.clear();
+    file.seekg(0, std::ios::end);
+    load_stats.bytes = (size_t)file.tellg();
+
     file.close();
     is_load_success = true;
-    std::cout << "[BVH] Loaded: " << file_name
-              << "  frames=" << num_frame << "\n";
+}
+
+void BVH::LoadMapped(const char* bvhFile, bool parallel, int streamWindow) {
+    auto mapping = std::make_shared<MappedFile>();
+    MappedFile& file = *mapping;
+    if (!file.open(bvhFile)) {
+        std::cerr << "[BVH] Cannot open: " << bvhFile << "\n";
+        return;
+    }
+
+    Clear();
+
+    file_name   = bvhFile;
+    motion_name = motionNameFromPath(bvhFile);
+
+    const char* p   = file.data();
+    const char* end = file.end();
+
+    int joint     = -1;
+    int new_joint = -1;
+
+    std::vector<int> stack;
+
+    // Parse HIERARCHY
+    bool foundMotion = false;
+    while (p < end) {
+        std::string_view line = nextLine(p, end);
+        std::string_view tok  = nextToken(line);
+        if (tok.empty()) continue;
+
+        if (tok == "{") {
+            stack.push_back(joint);
+            joint = new_joint;
+            continue;
+        }
+        if (tok == "}") {
+            if (stack.empty()) continue;
+            joint = stack.back();
+            stack.pop_back();
+            continue;
+        }
+
+        if (tok == "ROOT" || tok == "JOINT" || tok == "End") {
+            new_joint = (int)joints.size();
+            Joint& nj        = joints.emplace_back();
+            nj.index         = new_joint;
+            nj.parent        = joint;
+            nj.channel_begin = (int)channels.size();
+            nj.has_site      = (tok == "End");
+
+            // Name is the rest of the line, trimmed
+            while (!line.empty() && line.front() == ' ')                          line.remove_prefix(1);
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' '))  line.remove_suffix(1);
+            nj.name.assign(line.data(), line.size());
+            continue;
+        }
+
+        if (tok == "OFFSET" && joint >= 0) {
+            double* offset = joints[joint].offset;
+            if (!toNumber(nextToken(line), offset[0]) || !toNumber(nextToken(line), offset[1]) ||
+                !toNumber(nextToken(line), offset[2])) {
+                std::cerr << "[BVH] Malformed OFFSET of " << joints[joint].name << ": " << bvhFile << "\n";
+                return;
+            }
+            continue;
+        }
+
+        if (tok == "CHANNELS" && joint >= 0) {
+            int count = 0;
+            if (!toNumber(nextToken(line), count) || count < 0) {
+                std::cerr << "[BVH] Malformed CHANNELS of " << joints[joint].name << ": " << bvhFile << "\n";
+                return;
+            }
+            joints[joint].channel_begin = (int)channels.size();
+            joints[joint].num_channels  = count;
+            for (int i = 0; i < count; i++) {
+                Channel& ch = channels.emplace_back();
+                ch.joint = joint;
+                ch.index = (int)channels.size() - 1;
+
+                tok = nextToken(line);
+                if      (tok.empty())        ch.type = X_ROTATION;
+                else if (tok == "Xrotation") ch.type = X_ROTATION;
+                else if (tok == "Yrotation") ch.type = Y_ROTATION;
+                else if (tok == "Zrotation") ch.type = Z_ROTATION;
+                else if (tok == "Xposition") ch.type = X_POSITION;
+                else if (tok == "Yposition") ch.type = Y_POSITION;
+                else                         ch.type = Z_POSITION;
+            }
+            continue;
+        }
+
+        if (tok == "MOTION") { foundMotion = true; break; }
+    }
+    if (!foundMotion) return;
+    if (!FinishSkeleton()) {
+        std::cerr << "[BVH] Unsupported hierarchy: " << bvhFile << "\n";
+        return;
+    }
+
+    // Parse MOTION header
+    {
+        std::string_view line = nextLine(p, end);
+        if (nextToken(line) != "Frames") return;
+        if (!toNumber(nextToken(line), num_frame) || num_frame < 0) {
+            std::cerr << "[BVH] Malformed Frames: " << bvhFile << "\n";
+            return;
+        }
+    }
+    {
+        std::string_view line  = nextLine(p, end);
+        size_t           colon = line.find(':');
+        if (colon == std::string_view::npos || line.substr(0, colon) != "Frame Time") return;
+        line.remove_prefix(colon + 1);
+        if (!toNumber(nextToken(line), interval)) {
+            std::cerr << "[BVH] Malformed Frame Time: " << bvhFile << "\n";
+            return;
+        }
+    }
+
+    num_channel      = (int)channels.size();
+    load_stats.bytes = file.size();
+
+    // Streaming: index frame lines now, decode windows on demand
+    if (streamWindow > 0) {
+        stream = std::make_unique<MotionStream>(mapping, p, num_frame, num_channel, streamWindow);
+        is_load_success = true;
+        return;
+    }
+
+    motion.assign((size_t)num_frame * num_channel, 0.0);
+
+    // One line per frame, parsed in place straight into the motion array
+    if (parallel && num_frame >= k_parallelMinFrames)
+        parseMotionParallel(p, end, motion.data(), num_frame, num_channel);
+    else
+        parseFrameLines(p, end, motion.data(), 0, num_frame, num_channel);
+
+    is_load_success = true;
 }
 
 // ---------------------------------------------------------------------------
 // UpdatePose
 // ---------------------------------------------------------------------------
 
-void BVH::UpdatePose(int frameNo, Body& body, float scale) {
-    UpdatePose(joints[0], motion.data() + (size_t)frameNo * num_channel, body, scale);
-}
+namespace {
 
-void BVH::UpdatePose(Joint* joint, const double* data, Body& body, float scale) {
-    using namespace glm;
+bool nameHas(const std::string& lower, std::initializer_list<const char*> words) {
+    for (const char* w : words)
+        if (lower.find(w) != std::string::npos) return true;
+    return false;
+}
 
-    joint->quat = quat(1, 0, 0, 0);
+// Limb roles by joint name, for the common rig conventions (LeftUpLeg /
+// LeftLeg / LeftFoot, LeftArm / LeftForeArm / LeftHand, thigh / shin, ...)
+enum class LimbRole { None, Top, Mid, End };
+
+LimbRole limbRole(std::string name) {
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (nameHas(name, { "foot", "ankle", "hand", "wrist" }))                         return LimbRole::End;
+    if (nameHas(name, { "upleg", "upperleg", "thigh", "hip", "upperarm", "shoulder" })) return LimbRole::Top;
+    if (nameHas(name, { "forearm", "lowerarm", "elbow", "knee", "shin", "calf", "leg" })) return LimbRole::Mid;
+    if (nameHas(name, { "arm" }))                                                     return LimbRole::Top;
+    return LimbRole::None;
+}
 
-    // Apply rotation channels via exponential map (Euler → quaternion)
-    for (auto* ch : joint->channels) {
-        float angle = (float)data[ch->index] * k_pi / 180.f / 2.f;
-        if      (ch->type == X_ROTATION) joint->quat *= glm::exp(angle * quat(0, 1, 0, 0));
-        else if (ch->type == Y_ROTATION) joint->quat *= glm::exp(angle * quat(0, 0, 1, 0));
-        else if (ch->type == Z_ROTATION) joint->quat *= glm::exp(angle * quat(0, 0, 0, 1));
-        joint->quat = glm::normalize(joint->quat);
+} // namespace
+
+std::shared_ptr<Skeleton> BVH::MakeSkeleton(float scale) const {
+    auto skeleton = std::make_shared<Skeleton>();
+    skeleton->parent.reserve(joints.size());
+    skeleton->child.reserve(joints.size());
+    skeleton->subtreeEnd.reserve(joints.size());
+    skeleton->isEnd.reserve(joints.size());
+    skeleton->offset.reserve(joints.size());
+    for (const auto& joint : joints) {
+        skeleton->parent.push_back(joint.parent);
+        skeleton->child.push_back(joint.HasChildren() ? joint.index + 1 : -1);   // first child follows its parent
+        skeleton->subtreeEnd.push_back(joint.subtree_end);
+        skeleton->isEnd.push_back(joint.has_site);
+        skeleton->offset.push_back(scale * glm::vec3(joint.offset[0], joint.offset[1], joint.offset[2]));
     }
 
-    Joint* parent = joint->parent;
-    if (!parent) {
-        // Root joint — position comes from the first three channels
-        joint->position = scale * vec3(data[0], data[1], data[2]);
-        body.add(-1, joint->children[0]->index,
-                 joint->position, joint->quat,
-                 vec3(0), quat(1, 0, 0, 0), joint->has_site);
+    // Limb ends: an end joint under a middle joint under a (non-root) top one
+    skeleton->limbEnd.assign(joints.size(), 0);
+    for (const auto& joint : joints) {
+        const int mid = joint.parent;
+        const int top = mid >= 0 ? joints[mid].parent : -1;
+        if (top <= 0 || limbRole(joint.name) != LimbRole::End) continue;
+        skeleton->limbEnd[joint.index] = limbRole(joints[mid].name) == LimbRole::Mid &&
+                                         limbRole(joints[top].name) == LimbRole::Top;
     }
-    else if (joint->has_site) {
-        // End effector — no rotation, just offset
-        joint->quat = quat(1, 0, 0, 0);
-        vec3 offset  = scale * vec3(joint->offset[0], joint->offset[1], joint->offset[2]);
-        joint->position = parent->quat * offset + parent->position;
-        body.add(parent->index, -1, offset, joint->quat,
-                 parent->position, parent->quat, joint->has_site);
+    return skeleton;
+}
+
+void BVH::UpdatePose(int frameNo, Body body, float scale) {
+    glm::vec3 rootPos;
+    if (!compressed.empty()) {
+        pose_rotations.resize(joints.size());
+        compressed.decode(frameNo, pose_rotations.data(), rootPos);
+        for (const auto& joint : joints)
+            body.setQ(joint.index, pose_rotations[joint.index]);
     }
     else {
-        vec3 offset  = scale * vec3(joint->offset[0], joint->offset[1], joint->offset[2]);
-        joint->position = parent->quat * offset + parent->position;
-        body.add(parent->index, joint->children[0]->index,
-                 offset, joint->quat,
-                 parent->position, parent->quat, joint->has_site);
+        if (tracks_pending) BuildRotationTracks(tracks_parallel);
+        const double* data = FrameData(frameNo);
+        if (!rotation_tracks.empty()) {
+            for (const auto& joint : joints)
+                body.setQ(joint.index, rotation_tracks.get(joint.index, frameNo));
+        }
+        else {
+            for (const auto& joint : joints)
+                body.setQ(joint.index, ChannelRotation(joint, data));
+        }
+        // Root position comes from the first three channels
+        rootPos = glm::vec3(data[0], data[1], data[2]);
+    }
+    body.clip->setRootPos(body.frame, scale * rootPos);
+
+    // End effectors carry their offset only
+    for (const auto& joint : joints)
+        if (joint.has_site && joint.parent >= 0) body.setQ(joint.index, glm::quat(1, 0, 0, 0));
+}
+
+// ---------------------------------------------------------------------------
+// Compress
+// ---------------------------------------------------------------------------
+
+void BVH::Compress(int keyInterval) {
+    if (!is_load_success || joints.empty() || !compressed.empty()) return;
+
+    // Only joints with rotation channels get a packed track
+    std::vector<int> tracks;
+    for (const auto& joint : joints) {
+        const Channel* ch = JointChannels(joint);
+        for (int i = 0; i < joint.num_channels; i++)
+            if (ch[i].type <= Z_ROTATION) { tracks.push_back(joint.index); break; }
     }
 
-    for (auto* child : joint->children)
-        UpdatePose(child, data, body, scale);
+    const size_t rawBytes = (size_t)num_frame * num_channel * sizeof(double);
+    compressed.build(num_frame, (int)joints.size(), tracks, keyInterval, rawBytes,
+        [this](int f, glm::quat* rotations, glm::vec3& rootPos) {
+            const double* data = FrameData(f);
+            for (const auto& joint : joints)
+                rotations[joint.index] = rotation_tracks.empty() ? ChannelRotation(joint, data)
+                                                                 : rotation_tracks.get(joint.index, f);
+            rootPos = glm::vec3(data[0], data[1], data[2]);
+        });
+
+    // Raw channels (and the rotations derived from them) are no longer needed
+    rotation_tracks.clear();
+    tracks_pending = false;
+    std::vector<double>().swap(motion);
+    motion_data = nullptr;
+    motion_map.reset();
+    stream.reset();
+
+    const auto& st = compressed.stats();
+    std::cout << "[BVH] Compressed: " << motion_name
+              << "  " << st.rawBytes / 1024 << " KB -> " << st.packedBytes / 1024 << " KB"
+              << " (" << st.Ratio() << "x)"
+              << "  max error " << st.maxAngleDeg << " deg (mean " << st.meanAngleDeg << ")"
+              << ", root " << st.maxRootError << "\n";
 }
 
 void BVH::RenderPose(glm::vec3 pos, glm::vec3 parentPos, float size) {
@@ -9,11 +9,42 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
+#include <memory>
 #include <glm/gtx/quaternion.hpp>
 
 #include "IK.h"
+#include "CompressedMotion.h"
+#include "EulerKernels.h"
+#include "MotionStream.h"
+#include "QuatTracks.h"
+
+// Options for BVH::Load. The mapped path scans the file in place and parses
+// numbers with std::from_chars; the stream path is the original getline/strtok
+// reader, kept for comparison.
+struct BVHLoadOptions {
+    bool mapped   = true;
+    bool parallel = true;   // mapped only: split MOTION lines over ThreadPool::shared()
+    bool useCache = true;   // read/write the <name>.bvhc sidecar (see BVHCache.cpp)
+    bool verbose  = true;   // print the "[BVH] Loaded" summary line
+
+    // > 0: do not decode the whole MOTION block; index frame lines and keep
+    // only this many decoded frames resident (see MotionStream). A valid
+    // .bvhc cache is still used since it is paged in on demand anyway.
+    int  streamWindow = 0;
+
+    // > 0: compress after loading with this root keyframe interval (BVH::Compress).
+    int  compressKeyInterval = 0;
+
+    // Convert every frame's Euler channels to quaternion tracks (QuatTracks)
+    // on the first UpdatePose, which then reads rotations instead of
+    // evaluating the kernels. Deferred so a cached reopen stays a mapping
+    // plus a header check; ignored when streaming.
+    bool quatTracks = true;
+};
+
+class MappedFile;
 
 class BVH {
 public:
@@ -22,25 +53,44 @@ public:
         X_POSITION, Y_POSITION, Z_POSITION
     };
 
-    struct Joint;
-
     struct Channel {
-        Joint*      joint = nullptr;
-        ChannelEnum type;
+        int         joint = 0;   // owning joint index
+        ChannelEnum type  = X_ROTATION;
         int         index = 0;
     };
 
+    // Joints are stored in depth-first (file) order: a parent precedes its
+    // children, and a joint's subtree is the index range [index, subtree_end).
+    // Each joint's channels are the contiguous run starting at channel_begin.
     struct Joint {
-        std::string              name;
-        int                      index   = 0;
-        Joint*                   parent  = nullptr;
-        std::vector<Joint*>      children;
-        double                   offset[3] = {};
-        bool                     has_site  = false;
-        double                   site[3]   = {};
-        std::vector<Channel*>    channels;
-        glm::quat                quat     = glm::quat(1, 0, 0, 0);
-        glm::vec3                position = glm::vec3(0);
+        std::string name;
+        int         index         = 0;
+        int         parent        = -1;   // -1 for the root
+        int         subtree_end   = 0;
+        int         channel_begin = 0;
+        int         num_channels  = 0;
+        double      offset[3]     = {};
+        bool        has_site      = false;
+
+        // Rotation channels in file order (at most three are used) and the
+        // kernel for their order, resolved at load time
+        euler::Kernel rotation       = euler::identity;
+        int           num_rot        = 0;
+        int           rot_channel[3] = {};
+        int           rot_axis[3]    = {};
+
+        bool HasChildren() const { return subtree_end > index + 1; }
+    };
+
+    // Throughput of the last Load() call.
+    struct LoadStats {
+        size_t bytes   = 0;
+        double seconds = 0.0;
+        bool   mapped  = false;
+        bool   cached  = false;   // served from the .bvhc sidecar
+
+        double BytesPerSec()          const { return seconds > 0 ? bytes / seconds : 0.0; }
+        double FramesPerSec(int nf)   const { return seconds > 0 ? nf / seconds : 0.0; }
     };
 
 public:
@@ -48,12 +98,13 @@ public:
     std::string                    file_name;
     std::string                    motion_name;
     int                            num_channel = 0;
-    std::vector<Channel*>          channels;
-    std::vector<Joint*>            joints;
-    std::map<std::string, Joint*>  joint_index;
+    std::vector<Channel>           channels;
+    std::vector<Joint>             joints;
+    std::vector<int>               joint_order;   // joint indices sorted by name (FindJoint)
     int                            num_frame = 0;
     double                         interval  = 0.0;
-    std::vector<double>            motion;   // [frame * num_channel + channel]
+    std::vector<double>            motion;   // [frame * num_channel + channel], empty while mapped from cache
+    LoadStats                      load_stats;
 
 public:
     BVH();
@@ -61,17 +112,101 @@ public:
     ~BVH();
 
     void Clear();
-    void Load(const char* bvhFile);
+    void Load(const char* bvhFile, const BVHLoadOptions& options = BVHLoadOptions());
 
     bool        IsLoadSuccess() const { return is_load_success; }
+    int         FindJoint(std::string_view name) const;   // -1 if absent
+    const Channel* JointChannels(const Joint& joint) const { return channels.data() + joint.channel_begin; }
     int         GetNumFrame()   const { return num_frame; }
     double      GetInterval()   const { return interval; }
-    double      GetMotion(int f, int c) const { return motion[(size_t)f * num_channel + c]; }
-    void        SetMotion(int f, int c, double v) { motion[(size_t)f * num_channel + c] = v; }
+    double      GetMotion(int f, int c) const { return FrameData(f)[c]; }
+    void        SetMotion(int f, int c, double v) {
+        if (IsCompressed()) return;   // raw channels are gone
+        if (motion_map || stream) DetachMotion();
+        motion[(size_t)f * num_channel + c] = v;
+        if (!rotation_tracks.empty()) {
+            const Joint& joint = joints[channels[c].joint];
+            rotation_tracks.set(joint.index, f, ChannelRotation(joint, FrameData(f)));
+        }
+    }
 
-    // Apply frame data to a Body skeleton.
-    void UpdatePose(int frameNo, Body& body, float scale = 1.f);
+    // Channel values of one frame; points into the cache mapping when the
+    // clip was loaded from a .bvhc file, or into the decoded window when
+    // streaming (valid until the next FrameData call). nullptr once compressed.
+    const double* FrameData(int f) const {
+        if (stream)       return stream->frame(f);
+        if (!motion_data) return nullptr;
+        return motion_data + (size_t)f * num_channel;
+    }
+    bool          IsMotionMapped()  const { return motion_map != nullptr; }
+    bool          IsStreaming()     const { return stream != nullptr; }
+
+    // Replaces the raw channels with a CompressedMotion store. UpdatePose
+    // keeps working (constant time per frame); GetMotion/FrameData do not.
+    void Compress(int keyInterval = 16);
+    bool IsCompressed() const { return !compressed.empty(); }
+    const CompressedMotion& GetCompressed() const { return compressed; }
+
+    // Precomputed local rotations; empty until BuildRotationTracks or, with
+    // BVHLoadOptions::quatTracks, the first UpdatePose of a fully loaded clip.
+    const QuatTracks& GetRotationTracks() const { return rotation_tracks; }
+    void BuildRotationTracks(bool parallel = true) {
+        tracks_pending = false;
+        rotation_tracks.build(*this, parallel);
+    }
+
+    // Streaming playback hint; no-op for fully loaded clips.
+    void Prefetch(int f) const { if (stream) stream->prefetch(f); }
+
+    // Copies mapped or streamed motion into 'motion' and releases the source.
+    void DetachMotion();
+
+    // Writes the hierarchy plus one MOTION line per clip frame (BVHWriter.cpp).
+    // Link rotations become Euler angles in each joint's channel order; the
+    // root position is the clip's root position / scale, as set by UpdatePose.
+    // parallel formats frames over ThreadPool::shared(); pass false when
+    // already running on a pool worker.
+    bool Save(const char* path, const MotionClip& clip, float scale = 1.f, bool parallel = true) const;
+
+    // Binary sidecar cache (BVHCache.cpp).
+    static std::string CachePath(const char* bvhFile);
+    bool SaveCache(const char* bvhFile) const;
+
+    // Links in joint order with offsets multiplied by scale, for MotionClip.
+    std::shared_ptr<Skeleton> MakeSkeleton(float scale = 1.f) const;
+
+    // Writes the local pose of frame frameNo (root position, link rotations)
+    // into body, whose clip is a base clip on MakeSkeleton(scale). The clip
+    // refreshes world transforms when they are read.
+    // Not thread-safe: it may build the rotation tracks on the first call,
+    // moves the streaming window and decodes compressed frames into member
+    // scratch, so calls on one BVH must not run concurrently (give each
+    // thread its own BVH, as MotionBatch does per clip).
+    void UpdatePose(int frameNo, Body body, float scale = 1.f);
 
-    static void UpdatePose(Joint* root, const double* data, Body& body, float scale = 1.f);
     static void RenderPose(glm::vec3 pos, glm::vec3 parentPos, float size);
+
+    // Local rotation of a joint from its Euler channels.
+    static glm::quat ChannelRotation(const Joint& joint, const double* data) {
+        return joint.rotation(data, joint.rot_channel, joint.rot_axis);
+    }
+
+private:
+    const double*               motion_data = nullptr;   // motion.data() or into motion_map
+    std::shared_ptr<MappedFile> motion_map;
+    std::unique_ptr<MotionStream> stream;
+    CompressedMotion              compressed;
+    QuatTracks                    rotation_tracks;
+    bool                          tracks_pending  = false;   // build rotation_tracks on first UpdatePose
+    bool                          tracks_parallel = true;
+    std::vector<glm::quat>        pose_rotations;   // UpdatePose scratch for compressed clips (not thread-safe)
+
+    // Derives subtree ranges, rotation kernels and the name index from the
+    // parent links and channels. Returns false unless the joints form one
+    // tree in depth-first order.
+    bool FinishSkeleton();
+
+    bool LoadCache(const char* bvhFile);
+    void LoadStream(const char* bvhFile);
+    void LoadMapped(const char* bvhFile, bool parallel, int streamWindow);
 };
@@ -0,0 +1,223 @@
+//
+// BVHCache.cpp
+// ConstraintBasedMotionEdit
+//
+// Binary sidecar cache (.bvhc) for parsed BVH clips.
+//
+// Layout (native endianness, all offsets from the start of the file):
+//   CacheHeader
+//   CacheJoint[numJoints]          flat joint table in BVH index order
+//   uint8_t   [numChannels]        ChannelEnum per channel
+//   char      [nameBytes]          joint names, not NUL-terminated
+//   padding to k_align
+//   double    [numFrames * numChannels]   motion, same layout as BVH::motion
+//
+// The cache is valid while the source file keeps the size and mtime
+// recorded in the header. Loading maps the file read-only and points
+// BVH::FrameData at the motion block, so nothing is parsed or copied and
+// several processes share the same pages.
+//
+
+#include "BVH.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+constexpr char     k_magic[4] = { 'B', 'V', 'H', 'C' };
+constexpr uint32_t k_version  = 1;
+constexpr uint64_t k_align    = 64;
+
+struct CacheHeader {
+    char     magic[4];
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t  sourceTime;      // last_write_time ticks of the source file
+    uint32_t numJoints;
+    uint32_t numChannels;
+    uint32_t numFrames;
+    uint32_t scalarBytes;     // sizeof(double)
+    double   interval;
+    uint64_t jointOffset;
+    uint64_t channelOffset;
+    uint64_t nameOffset;
+    uint64_t nameBytes;
+    uint64_t motionOffset;
+};
+
+struct CacheJoint {
+    int32_t  parent;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t firstChannel;
+    uint32_t numChannels;
+    uint32_t hasSite;
+    double   offset[3];
+};
+
+uint64_t alignUp(uint64_t v) { return (v + k_align - 1) / k_align * k_align; }
+
+// Size and mtime of the source file; false if it cannot be stat'ed.
+bool sourceStamp(const char* bvhFile, uint64_t& size, int64_t& time) {
+    std::error_code ec;
+    auto path = std::filesystem::u8path(bvhFile);
+    size = (uint64_t)std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    time = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+} // namespace
+
+std::string BVH::CachePath(const char* bvhFile) {
+    std::string path = bvhFile;
+    size_t dot   = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        path.erase(dot);
+    return path + ".bvhc";
+}
+
+bool BVH::LoadCache(const char* bvhFile) {
+    uint64_t srcSize = 0;
+    int64_t  srcTime = 0;
+    if (!sourceStamp(bvhFile, srcSize, srcTime)) return false;
+
+    auto map = std::make_shared<MappedFile>();
+    if (!map->open(CachePath(bvhFile).c_str())) return false;
+    if (map->size() < sizeof(CacheHeader)) return false;
+
+    CacheHeader h;
+    memcpy(&h, map->data(), sizeof(h));
+    if (memcmp(h.magic, k_magic, 4) != 0 || h.version != k_version) return false;
+    if (h.sourceSize != srcSize || h.sourceTime != srcTime)          return false;
+    if (h.scalarBytes != sizeof(double) || h.numJoints == 0)         return false;
+
+    const uint64_t motionBytes = (uint64_t)h.numFrames * h.numChannels * sizeof(double);
+    if (h.jointOffset   + (uint64_t)h.numJoints * sizeof(CacheJoint) > map->size() ||
+        h.channelOffset + h.numChannels                              > map->size() ||
+        h.nameOffset    + h.nameBytes                                > map->size() ||
+        h.motionOffset  + motionBytes                                > map->size())
+        return false;
+
+    Clear();
+
+    const char*    base  = map->data();
+    const uint8_t* types = (const uint8_t*)(base + h.channelOffset);
+    const char*    names = base + h.nameOffset;
+
+    joints.reserve(h.numJoints);
+    channels.reserve(h.numChannels);
+    for (uint32_t i = 0; i < h.numJoints; i++) {
+        CacheJoint cj;
+        memcpy(&cj, base + h.jointOffset + i * sizeof(CacheJoint), sizeof(cj));
+        if (cj.parent >= (int32_t)i || cj.nameOffset + (uint64_t)cj.nameLength > h.nameBytes ||
+            cj.firstChannel != channels.size() ||
+            cj.firstChannel + (uint64_t)cj.numChannels > h.numChannels) {
+            Clear();
+            return false;
+        }
+
+        Joint& joint        = joints.emplace_back();
+        joint.index         = (int)i;
+        joint.parent        = cj.parent;
+        joint.channel_begin = (int)cj.firstChannel;
+        joint.num_channels  = (int)cj.numChannels;
+        joint.has_site      = cj.hasSite != 0;
+        joint.name.assign(names + cj.nameOffset, cj.nameLength);
+        for (int k = 0; k < 3; k++) joint.offset[k] = cj.offset[k];
+
+        for (uint32_t c = 0; c < cj.numChannels; c++) {
+            Channel& ch = channels.emplace_back();
+            ch.joint = (int)i;
+            ch.index = (int)(cj.firstChannel + c);
+            ch.type  = (ChannelEnum)types[ch.index];
+        }
+    }
+    if (!FinishSkeleton()) {
+        Clear();
+        return false;
+    }
+
+    num_channel      = (int)h.numChannels;
+    num_frame        = (int)h.numFrames;
+    interval         = h.interval;
+    motion_map       = map;
+    motion_data      = (const double*)(base + h.motionOffset);
+    load_stats.bytes = map->size();
+    is_load_success  = true;
+    return true;
+}
+
+bool BVH::SaveCache(const char* bvhFile) const {
+    if (!is_load_success || joints.empty()) return false;
+
+    CacheHeader h = {};
+    memcpy(h.magic, k_magic, 4);
+    h.version     = k_version;
+    h.numJoints   = (uint32_t)joints.size();
+    h.numChannels = (uint32_t)num_channel;
+    h.numFrames   = (uint32_t)num_frame;
+    h.scalarBytes = sizeof(double);
+    h.interval    = interval;
+    if (!sourceStamp(bvhFile, h.sourceSize, h.sourceTime)) return false;
+
+    std::vector<CacheJoint> table(joints.size());
+    std::vector<uint8_t>    types(channels.size());
+    std::string             names;
+    for (size_t i = 0; i < joints.size(); i++) {
+        const Joint& j  = joints[i];
+        CacheJoint&  cj = table[i];
+        cj.parent       = j.parent;
+        cj.nameOffset   = (uint32_t)names.size();
+        cj.nameLength   = (uint32_t)j.name.size();
+        cj.firstChannel = (uint32_t)j.channel_begin;
+        cj.numChannels  = (uint32_t)j.num_channels;
+        cj.hasSite      = j.has_site ? 1 : 0;
+        for (int k = 0; k < 3; k++) cj.offset[k] = j.offset[k];
+        names += j.name;
+    }
+    for (const auto& ch : channels) types[ch.index] = (uint8_t)ch.type;
+
+    h.jointOffset   = sizeof(CacheHeader);
+    h.channelOffset = h.jointOffset + table.size() * sizeof(CacheJoint);
+    h.nameOffset    = h.channelOffset + types.size();
+    h.nameBytes     = names.size();
+    h.motionOffset  = alignUp(h.nameOffset + h.nameBytes);
+
+    // Write next to the final path and rename, so readers never see a partial file
+    const std::string path = CachePath(bvhFile);
+    const std::string tmp  = path + ".tmp";
+    {
+        std::ofstream out(std::filesystem::u8path(tmp), std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+
+        static const char zeros[k_align] = {};
+        out.write((const char*)&h, sizeof(h));
+        out.write((const char*)table.data(), table.size() * sizeof(CacheJoint));
+        out.write((const char*)types.data(), types.size());
+        out.write(names.data(), names.size());
+        out.write(zeros, (std::streamsize)(h.motionOffset - (h.nameOffset + h.nameBytes)));
+        out.write((const char*)motion_data, (std::streamsize)((size_t)num_frame * num_channel * sizeof(double)));
+        if (!out.good()) {
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(std::filesystem::u8path(tmp), ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(std::filesystem::u8path(tmp), std::filesystem::u8path(path), ec);
+    if (ec) {
+        std::filesystem::remove(std::filesystem::u8path(tmp), ec);
+        std::cerr << "[BVH] Cannot write cache: " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+//
+// BVHText.h
+// ConstraintBasedMotionEdit
+//
+// In-place scanning helpers for BVH text, shared by the mapped loader
+// and the streaming frame decoder.
+//
+
+#pragma once
+
+#include <charconv>
+#include <system_error>
+
+namespace bvhtext {
+
+// Same separator set as the strtok-based reader: " :,\t\r"
+inline bool isSep(char c) {
+    return c == ' ' || c == ':' || c == ',' || c == '\t' || c == '\r';
+}
+
+// Reads one number from the start of [p, end) like atof / atoi would: an
+// optional leading '+' (which from_chars does not take) is skipped. Returns
+// the end of the number, or nullptr if [p, end) does not start with one.
+template <class T>
+inline const char* parseNumber(const char* p, const char* end, T& out) {
+    if (p < end && *p == '+' && p + 1 < end && p[1] != '+' && p[1] != '-') p++;
+    auto [next, ec] = std::from_chars(p, end, out);
+    return ec == std::errc() ? next : nullptr;
+}
+
+// Parses up to 'count' numbers of one frame line [p, end) directly into out.
+// Missing values are left untouched. Each token reads like atof on the
+// strtok reader's token (see parseNumber): trailing junk after the number is
+// ignored and a token that does not start with a number reads as 0.
+inline void parseFrameLine(const char* p, const char* end, double* out, int count) {
+    for (int j = 0; j < count; j++) {
+        while (p < end && isSep(*p)) p++;
+        if (p == end) return;
+        const char* next = parseNumber(p, end, out[j]);
+        if (!next) {
+            out[j] = 0.0;
+            next   = p;
+        }
+        while (next < end && !isSep(*next)) next++;
+        p = next;
+    }
+}
+
+} // namespace bvhtext
@@ -0,0 +1,246 @@
+//
+// BVHWriter.cpp
+// ConstraintBasedMotionEdit
+//
+// BVH export: writes the loaded hierarchy and a MOTION block built from the
+// frames of an (edited) MotionClip. Local quaternions are converted back to
+// Euler angles in each joint's original channel order. Frames are formatted
+// with std::to_chars in parallel chunks and written with large sequential
+// writes.
+//
+
+#include "BVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace {
+
+constexpr double k_rad2deg    = 180.0 / 3.14159265358979323846;
+constexpr int    k_batchFrames = 8192;   // frames formatted per parallel batch
+
+void appendNumber(std::string& out, double v) {
+    char buf[64];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, 6);
+    out.append(buf, r.ptr);
+}
+
+// Shifts a by whole turns so it lies within 180 degrees of ref.
+double unwrap(double a, double ref) {
+    return a + 360.0 * std::round((ref - a) / 360.0);
+}
+
+// Decomposes R = R_i(t0) R_j(t1) R_k(t2) for a Tait-Bryan order (i, j, k).
+// M is row-major. Returns degrees; also fills the alternate solution.
+void eulerFromMatrix(const double M[3][3], int i, int j, int k, double out[3], double alt[3]) {
+    // Parity: +1 for cyclic orders (XYZ, YZX, ZXY), -1 otherwise
+    const double e = ((j - i + 3) % 3 == 1) ? 1.0 : -1.0;
+
+    double s  = std::clamp(e * M[i][k], -1.0, 1.0);
+    double t1 = std::asin(s);
+    double t0, t2;
+    if (std::fabs(s) < 0.9999999) {
+        t0 = std::atan2(-e * M[j][k], M[k][k]);
+        t2 = std::atan2(-e * M[i][j], M[i][i]);
+    }
+    else {
+        // Gimbal lock: fold everything into the first angle
+        t0 = std::atan2(e * M[k][j], M[j][j]);
+        t2 = 0.0;
+    }
+
+    out[0] = t0 * k_rad2deg;
+    out[1] = t1 * k_rad2deg;
+    out[2] = t2 * k_rad2deg;
+    alt[0] = out[0] + 180.0;
+    alt[1] = 180.0 - out[1];
+    alt[2] = out[2] + 180.0;
+}
+
+// Euler angles (degrees, channel order) for q. With a reference frame the
+// solution and the turn count closest to the reference are chosen, which
+// keeps curves continuous with the source clip.
+void eulerAngles(const glm::quat& qIn, const BVH::Joint& joint, const double* ref, double out[3]) {
+    glm::quat q = glm::normalize(qIn);
+
+    if (joint.num_rot == 1) {
+        const float c[3] = { q.x, q.y, q.z };
+        out[0] = 2.0 * std::atan2((double)c[joint.rot_axis[0]], (double)q.w) * k_rad2deg;
+        if (ref) out[0] = unwrap(out[0], ref[joint.rot_channel[0]]);
+        return;
+    }
+
+    // Row-major rotation matrix (glm::mat3 is column-major)
+    glm::mat3 m = glm::mat3_cast(q);
+    double M[3][3];
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            M[r][c] = m[c][r];
+
+    // Two-channel joints: complete the order with the missing axis, drop it
+    int a0 = joint.rot_axis[0], a1 = joint.rot_axis[1];
+    int a2 = joint.num_rot == 3 ? joint.rot_axis[2] : 3 - a0 - a1;
+
+    double sol[3], alt[3];
+    eulerFromMatrix(M, a0, a1, a2, sol, alt);
+
+    if (ref) {
+        double costSol = 0.0, costAlt = 0.0;
+        for (int s = 0; s < joint.num_rot; s++) {
+            double r = ref[joint.rot_channel[s]];
+            sol[s]   = unwrap(sol[s], r);
+            alt[s]   = unwrap(alt[s], r);
+            costSol += (sol[s] - r) * (sol[s] - r);
+            costAlt += (alt[s] - r) * (alt[s] - r);
+        }
+        if (costAlt < costSol) std::copy(alt, alt + 3, sol);
+    }
+    for (int s = 0; s < joint.num_rot; s++) out[s] = sol[s];
+}
+
+const char* channelName(BVH::ChannelEnum type) {
+    switch (type) {
+    case BVH::X_ROTATION: return "Xrotation";
+    case BVH::Y_ROTATION: return "Yrotation";
+    case BVH::Z_ROTATION: return "Zrotation";
+    case BVH::X_POSITION: return "Xposition";
+    case BVH::Y_POSITION: return "Yposition";
+    default:              return "Zposition";
+    }
+}
+
+void writeJoint(std::string& out, const BVH& bvh, int j, int depth) {
+    const BVH::Joint& joint = bvh.joints[j];
+    const std::string indent(depth, '\t');
+
+    if (joint.has_site)        out += indent + "End Site\n";
+    else if (joint.parent < 0) out += indent + "ROOT " + joint.name + "\n";
+    else                       out += indent + "JOINT " + joint.name + "\n";
+    out += indent + "{\n";
+
+    out += indent + "\tOFFSET ";
+    for (int k = 0; k < 3; k++) {
+        appendNumber(out, joint.offset[k]);
+        out += k < 2 ? " " : "\n";
+    }
+
+    if (joint.num_channels > 0) {
+        const BVH::Channel* ch = bvh.JointChannels(joint);
+        out += indent + "\tCHANNELS " + std::to_string(joint.num_channels);
+        for (int i = 0; i < joint.num_channels; i++) {
+            out += " ";
+            out += channelName(ch[i].type);
+        }
+        out += "\n";
+    }
+
+    // Children are the subtrees that tile [j + 1, subtree_end)
+    for (int c = j + 1; c < joint.subtree_end; c = bvh.joints[c].subtree_end)
+        writeJoint(out, bvh, c, depth + 1);
+    out += indent + "}\n";
+}
+
+} // namespace
+
+bool BVH::Save(const char* path, const MotionClip& clip, float scale, bool parallel) const {
+    if (!is_load_success || joints.empty() || clip.empty()) return false;
+    if (clip.numLinks() != (int)joints.size()) {
+        std::cerr << "[BVH] Save: clip has " << clip.numLinks()
+                  << " links, skeleton has " << joints.size() << " joints\n";
+        return false;
+    }
+
+    FILE* file = nullptr;
+#ifdef _WIN32
+    file = _wfopen(std::filesystem::u8path(path).c_str(), L"wb");
+#else
+    file = fopen(path, "wb");
+#endif
+    if (!file) {
+        std::cerr << "[BVH] Cannot write: " << path << "\n";
+        return false;
+    }
+
+    // Hierarchy + MOTION header
+    std::string header = "HIERARCHY\n";
+    writeJoint(header, *this, 0, 0);
+    header += "MOTION\nFrames: " + std::to_string(clip.numFrames()) + "\nFrame Time: ";
+    appendNumber(header, interval);
+    header += "\n";
+    fwrite(header.data(), 1, header.size(), file);
+
+    // Source channels give continuity and non-root position values. Streamed
+    // frames cannot be read from several threads, so those are skipped.
+    const bool hasSource = !IsStreaming() && !IsCompressed() && clip.numFrames() == num_frame;
+    const int  numFrames = clip.numFrames();
+    const float invScale = scale != 0.f ? 1.f / scale : 1.f;
+
+    ThreadPool&              pool = ThreadPool::shared();
+    const int                numChunks = parallel ? pool.size() * 4 : 1;
+    std::vector<std::string> chunks(numChunks);
+    std::vector<double>      values((size_t)numChunks * num_channel);   // one frame row per chunk
+
+    for (int batch = 0; batch < numFrames; batch += k_batchFrames) {
+        const int batchEnd = std::min(batch + k_batchFrames, numFrames);
+        const int batchLen = batchEnd - batch;
+
+        auto writeChunks = [&](int cb, int ce) {
+            for (int c = cb; c < ce; c++) {
+                std::string& out = chunks[c];
+                double*      row = values.data() + (size_t)c * num_channel;
+                out.clear();
+                const int f0 = batch + (int)((long long)batchLen * c / numChunks);
+                const int f1 = batch + (int)((long long)batchLen * (c + 1) / numChunks);
+                out.reserve((size_t)(f1 - f0) * num_channel * 12);
+
+                for (int f = f0; f < f1; f++) {
+                    const double* ref  = hasSource ? FrameData(f) : nullptr;
+
+                    for (const auto& joint : joints) {
+                        double euler[3] = { 0, 0, 0 };
+                        if (joint.num_rot > 0)
+                            eulerAngles(clip.localQ(joint.index, f), joint, ref, euler);
+
+                        const Channel* ch = JointChannels(joint);
+                        int r = 0;
+                        for (int i = 0; i < joint.num_channels; i++) {
+                            const int c = ch[i].index;
+                            if (ch[i].type <= Z_ROTATION) {
+                                row[c] = r < 3 ? euler[r] : 0.0;
+                                r++;
+                            }
+                            else if (joint.parent < 0) {
+                                row[c] = clip.rootPos(f)[ch[i].type - X_POSITION] * invScale;
+                            }
+                            else {
+                                row[c] = ref ? ref[c] : joint.offset[ch[i].type - X_POSITION];
+                            }
+                        }
+                    }
+
+                    for (int k = 0; k < num_channel; k++) {
+                        if (k) out += ' ';
+                        appendNumber(out, row[k]);
+                    }
+                    out += '\n';
+                }
+            }
+        };
+        if (parallel) pool.parallelFor(numChunks, 1, writeChunks);
+        else          writeChunks(0, numChunks);
+
+        for (const auto& chunk : chunks)
+            fwrite(chunk.data(), 1, chunk.size(), file);
+    }
+
+    bool ok = ferror(file) == 0;
+    ok &= fclose(file) == 0;
+    if (!ok) std::cerr << "[BVH] Write failed: " << path << "\n";
+    return ok;
+}
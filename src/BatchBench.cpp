@@ -0,0 +1,617 @@
+//
+// BatchBench.cpp
+// ConstraintBasedMotionEdit
+//
+// MotionBatch microbenchmarks. Synthetic inputs are generated with a fixed
+// seed so runs are comparable; all timings are single-threaded.
+//
+
+#include "BatchBench.h"
+#include "EulerKernels.h"
+#include "IK.h"
+#include "IKKernels.h"
+#include "QuatTracks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>   // _aligned_malloc
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// ---------------------------------------------------------------------------
+// Heap allocation counter
+// ---------------------------------------------------------------------------
+// MotionBatch replaces the global operator new so a benchmark can check that
+// a hot path does not allocate. Every replaceable form (array, nothrow and
+// over-aligned) counts, and each delete matches its new. Eigen allocates
+// with malloc, out of the counter's sight; see EigenMallocGuard.
+
+static std::atomic<size_t> g_heapAllocations{ 0 };
+
+static void* countedAlloc(size_t bytes) noexcept {
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(bytes ? bytes : 1);
+}
+
+static void* countedAlloc(size_t bytes, std::align_val_t align) noexcept {
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t a = (size_t)align;
+    bytes = (bytes + a - 1) / a * a;   // aligned_alloc wants a multiple of the alignment
+#ifdef _WIN32
+    return _aligned_malloc(bytes ? bytes : a, a);
+#else
+    return std::aligned_alloc(a, bytes ? bytes : a);
+#endif
+}
+
+// Not inlined: g++ would otherwise see free() applied to an operator new
+// result at every inlined delete and warn (-Wmismatched-new-delete).
+#ifdef _MSC_VER
+#define HEAP_NOINLINE __declspec(noinline)
+#else
+#define HEAP_NOINLINE __attribute__((noinline))
+#endif
+
+HEAP_NOINLINE static void heapFree(void* p) noexcept { std::free(p); }
+
+HEAP_NOINLINE static void alignedFree(void* p) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* operator new(size_t bytes) {
+    if (void* p = countedAlloc(bytes)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t bytes) {
+    if (void* p = countedAlloc(bytes)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t bytes, std::align_val_t align) {
+    if (void* p = countedAlloc(bytes, align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t bytes, std::align_val_t align) {
+    if (void* p = countedAlloc(bytes, align)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept   { return countedAlloc(bytes); }
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept { return countedAlloc(bytes); }
+void* operator new(size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept   { return countedAlloc(bytes, align); }
+void* operator new[](size_t bytes, std::align_val_t align, const std::nothrow_t&) noexcept { return countedAlloc(bytes, align); }
+
+void operator delete(void* p) noexcept                                          { heapFree(p); }
+void operator delete[](void* p) noexcept                                        { heapFree(p); }
+void operator delete(void* p, size_t) noexcept                                  { heapFree(p); }
+void operator delete[](void* p, size_t) noexcept                                { heapFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept                   { heapFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept                 { heapFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept                        { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept                      { alignedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept                { alignedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept              { alignedFree(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept   { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { alignedFree(p); }
+
+// MotionBatch is built with EIGEN_RUNTIME_NO_MALLOC. While a guard is alive,
+// an Eigen allocation (dynamic matrix resize, sparse insert, LDLT workspace)
+// fails Eigen's malloc check, which is an eigen_assert: it aborts in Debug
+// builds and is compiled out in Release, so run the allocation checks from
+// a Debug build. The flag is global, so guards are for single-threaded runs.
+struct EigenMallocGuard {
+    EigenMallocGuard()  { allow(false); }
+    ~EigenMallocGuard() { allow(true); }
+    static void allow(bool allowed) {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        Eigen::internal::set_is_malloc_allowed(allowed);
+#else
+        (void)allowed;
+#endif
+    }
+};
+
+// ---------------------------------------------------------------------------
+// bench-euler
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Synthetic clip: root position plus three rotation channels per joint in a
+// random order (including repeated-axis orders). Only one block of frames is
+// materialized and replayed until the requested frame count is reached, so a
+// million-frame run fits in memory.
+struct EulerClip {
+    int                 numJoints  = 0;
+    int                 numChannel = 0;
+    int                 blockFrames = 0;
+    std::vector<double> motion;    // [frame * numChannel + channel]
+    std::vector<int>    channel;   // [joint * 3 + s]
+    std::vector<int>    axis;
+    std::vector<euler::Kernel> kernels;
+
+    EulerClip(int joints, int frames) : numJoints(joints), blockFrames(frames) {
+        std::mt19937 rng(1234);
+        std::uniform_int_distribution<int>     pickAxis(0, 2);
+        std::uniform_real_distribution<double> pickAngle(-180.0, 180.0);
+
+        numChannel = 3 + 3 * numJoints;
+        channel.resize(3 * numJoints);
+        axis.resize(3 * numJoints);
+        kernels.resize(numJoints);
+        for (int j = 0; j < numJoints; j++) {
+            for (int s = 0; s < 3; s++) {
+                channel[3 * j + s] = 3 + 3 * j + s;
+                axis[3 * j + s]    = pickAxis(rng);
+            }
+            kernels[j] = euler::select(&axis[3 * j], 3);
+        }
+
+        motion.resize((size_t)blockFrames * numChannel);
+        for (double& v : motion) v = pickAngle(rng);
+    }
+};
+
+// Planes for one block: [c][joint * blockFrames + frame]
+struct QuatBlock {
+    int                frames;
+    size_t             plane;
+    std::vector<float> data;
+
+    QuatBlock(int joints, int n) : frames(n), plane((size_t)joints * n), data(4 * plane) {}
+    float* w(int joint) { return data.data() + (size_t)joint * frames; }
+};
+
+// Per-frame path: what UpdatePose does without tracks
+static void convertScalar(const EulerClip& clip, QuatBlock& out) {
+    const int n = clip.blockFrames;
+    for (int f = 0; f < n; f++) {
+        const double* row = clip.motion.data() + (size_t)f * clip.numChannel;
+        for (int j = 0; j < clip.numJoints; j++) {
+            glm::quat q = clip.kernels[j](row, &clip.channel[3 * j], &clip.axis[3 * j]);
+            float* w = out.w(j);
+            w[f]                 = q.w;
+            w[out.plane + f]     = q.x;
+            w[2 * out.plane + f] = q.y;
+            w[3 * out.plane + f] = q.z;
+        }
+    }
+}
+
+// Load-time path: tiled like QuatTracks::build
+static void convertBatch(const EulerClip& clip, QuatBlock& out, QuatTracks::Isa isa) {
+    const int n = clip.blockFrames;
+    for (int f0 = 0; f0 < n; f0 += QuatTracks::k_blockFrames) {
+        const int f1 = std::min(f0 + QuatTracks::k_blockFrames, n);
+        for (int j = 0; j < clip.numJoints; j++) {
+            float* w = out.w(j);
+            QuatTracks::convert(clip.motion.data(), clip.numChannel, &clip.channel[3 * j], &clip.axis[3 * j], 3,
+                                f0, f1, w, w + out.plane, w + 2 * out.plane, w + 3 * out.plane, isa);
+        }
+    }
+}
+
+// Largest component difference, up to the sign of q
+static double maxDifference(const QuatBlock& a, const QuatBlock& b) {
+    double worst = 0.0;
+    for (size_t i = 0; i < a.plane; i++) {
+        double same = 0.0, flip = 0.0;
+        for (int c = 0; c < 4; c++) {
+            same = std::max(same, (double)std::fabs(a.data[c * a.plane + i] - b.data[c * b.plane + i]));
+            flip = std::max(flip, (double)std::fabs(a.data[c * a.plane + i] + b.data[c * b.plane + i]));
+        }
+        worst = std::max(worst, std::min(same, flip));
+    }
+    return worst;
+}
+
+} // namespace
+
+int benchEuler(int argc, char** argv) {
+    const int       numJoints = argc > 0 ? std::atoi(argv[0]) : 200;
+    const long long numFrames = argc > 1 ? std::atoll(argv[1]) : 1000000;
+    if (numJoints <= 0 || numFrames <= 0) {
+        std::cerr << "usage: MotionBatch bench-euler [joints=200] [frames=1000000]\n";
+        return 1;
+    }
+
+    const int blockFrames = (int)std::min<long long>(numFrames, 8192);
+    const int numBlocks   = (int)((numFrames + blockFrames - 1) / blockFrames);
+    const double rotations = (double)numBlocks * blockFrames * numJoints;
+
+    EulerClip clip(numJoints, blockFrames);
+    QuatBlock reference(numJoints, blockFrames);
+    std::cout << "[bench-euler] " << numJoints << " joints x " << (long long)numBlocks * blockFrames
+              << " frames (" << blockFrames << "-frame block replayed), best ISA: "
+              << QuatTracks::isaName(QuatTracks::bestIsa()) << "\n";
+
+    auto t0 = Clock::now();
+    for (int b = 0; b < numBlocks; b++) convertScalar(clip, reference);
+    const double scalarSec = secondsSince(t0);
+    std::cout << "  " << std::left << std::setw(16) << "per-frame" << scalarSec * 1e9 / rotations << " ns/rotation\n";
+
+    std::vector<QuatTracks::Isa> isas = { QuatTracks::Isa::Scalar };
+    if (QuatTracks::bestIsa() >= QuatTracks::Isa::Sse2) isas.push_back(QuatTracks::Isa::Sse2);
+    if (QuatTracks::bestIsa() >= QuatTracks::Isa::Avx2) isas.push_back(QuatTracks::Isa::Avx2);
+
+    QuatBlock out(numJoints, blockFrames);
+    for (QuatTracks::Isa isa : isas) {
+        t0 = Clock::now();
+        for (int b = 0; b < numBlocks; b++) convertBatch(clip, out, isa);
+        const double sec = secondsSince(t0);
+        std::cout << "  batch " << std::setw(10) << QuatTracks::isaName(isa) << sec * 1e9 / rotations << " ns/rotation, "
+                  << (sec > 0 ? scalarSec / sec : 0.0) << "x, max diff "
+                  << maxDifference(reference, out) << "\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// bench-fk
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Random tree in depth-first order: each joint hangs off some joint on the
+// path from the root to its predecessor, so subtrees stay contiguous.
+std::shared_ptr<Skeleton> makeSkeleton(int numJoints, std::mt19937& rng) {
+    std::uniform_real_distribution<float> pickOffset(-10.f, 10.f);
+    auto sk = std::make_shared<Skeleton>();
+    std::vector<int> path;
+    for (int i = 0; i < numJoints; i++) {
+        int parent = -1;
+        if (i > 0) {
+            const int depth = std::uniform_int_distribution<int>(0, (int)path.size() - 1)(rng);
+            parent = path[depth];
+            path.resize(depth + 1);
+        }
+        path.push_back(i);
+        sk->parent.push_back(parent);
+        sk->offset.push_back(glm::vec3(pickOffset(rng), pickOffset(rng), pickOffset(rng)));
+    }
+
+    sk->child.assign(numJoints, -1);
+    sk->subtreeEnd.resize(numJoints);
+    for (int i = numJoints - 1; i >= 0; i--) {
+        sk->subtreeEnd[i] = std::max(sk->subtreeEnd[i], i + 1);
+        const int p = sk->parent[i];
+        if (p < 0) continue;
+        sk->child[p]      = i;   // ends at the lowest index, the first child
+        sk->subtreeEnd[p] = std::max(sk->subtreeEnd[p], sk->subtreeEnd[i]);
+    }
+    for (int i = 0; i < numJoints; i++) sk->isEnd.push_back(sk->child[i] < 0);
+    return sk;
+}
+
+void randomPose(MotionClip& clip, std::mt19937& rng) {
+    std::uniform_real_distribution<float> pick(-1.f, 1.f);
+    for (int f = 0; f < clip.numFrames(); f++) {
+        clip.setRootPos(f, 100.f * glm::vec3(pick(rng), pick(rng), pick(rng)));
+        for (int i = 0; i < clip.numLinks(); i++)
+            clip.setLocalQ(i, f, glm::normalize(glm::quat(pick(rng), pick(rng), pick(rng), pick(rng))));
+    }
+}
+
+} // namespace
+
+int benchFK(int argc, char** argv) {
+    const int frames = argc > 0 ? std::atoi(argv[0]) : 10000;
+    std::vector<int> jointCounts;
+    for (int i = 1; i < argc; i++) jointCounts.push_back(std::atoi(argv[i]));
+    if (jointCounts.empty()) jointCounts = { 31, 200 };
+    if (frames <= 0 || *std::min_element(jointCounts.begin(), jointCounts.end()) <= 0) {
+        std::cerr << "usage: MotionBatch bench-fk [frames=10000] [joints ...]\n";
+        return 1;
+    }
+
+    std::vector<QuatTracks::Isa> isas = { QuatTracks::Isa::Scalar };
+    if (QuatTracks::bestIsa() >= QuatTracks::Isa::Sse2) isas.push_back(QuatTracks::Isa::Sse2);
+    if (QuatTracks::bestIsa() >= QuatTracks::Isa::Avx2) isas.push_back(QuatTracks::Isa::Avx2);
+
+    for (int numJoints : jointCounts) {
+        std::mt19937 rng(1234);
+        MotionClip   clip;
+        clip.create(makeSkeleton(numJoints, rng), frames);
+        randomPose(clip, rng);
+        clip.updateWorld(false);   // allocates the world planes
+        const double transforms = (double)frames * numJoints;
+
+        std::cout << "[bench-fk] " << numJoints << " joints x " << frames << " frames\n";
+
+        // Reference: the interactive path, one frame at a time
+        auto t0 = Clock::now();
+        for (int f = 0; f < frames; f++) Body(clip, f).updatePos();
+        const double scalarSec = secondsSince(t0);
+        std::cout << "  " << std::left << std::setw(16) << "updatePos" << scalarSec * 1e9 / transforms << " ns/joint\n";
+
+        std::vector<glm::vec3> reference((size_t)frames * numJoints);
+        for (int f = 0; f < frames; f++)
+            for (int i = 0; i < numJoints; i++) reference[(size_t)f * numJoints + i] = clip.worldP(i, f);
+
+        for (QuatTracks::Isa isa : isas) {
+            clip.invalidateFrames(0, frames);
+            t0 = Clock::now();
+            clip.updateWorld(false, isa);
+            const double sec = secondsSince(t0);
+
+            double worst = 0.0;
+            for (int f = 0; f < frames; f++)
+                for (int i = 0; i < numJoints; i++)
+                    worst = std::max(worst, (double)glm::length(clip.worldP(i, f) - reference[(size_t)f * numJoints + i]));
+            std::cout << "  block " << std::setw(10) << QuatTracks::isaName(isa) << sec * 1e9 / transforms << " ns/joint, "
+                      << (sec > 0 ? scalarSec / sec : 0.0) << "x, max diff " << worst << "\n";
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// bench-ik
+// ---------------------------------------------------------------------------
+
+int benchIK(int argc, char** argv) {
+    const int solves = argc > 0 ? std::atoi(argv[0]) : 10000;
+    std::vector<int> jointCounts;
+    for (int i = 1; i < argc; i++) jointCounts.push_back(std::atoi(argv[i]));
+    if (jointCounts.empty()) jointCounts = { 31, 200 };
+    if (solves <= 0 || *std::min_element(jointCounts.begin(), jointCounts.end()) <= 1) {
+        std::cerr << "usage: MotionBatch bench-ik [solves=10000] [joints ...]\n";
+        return 1;
+    }
+
+    constexpr int frames = 64;
+    // two-bone: the effector is marked as a limb end, so targets within
+    // reach of its last two bones are solved in closed form. multi: the four
+    // deepest leaves (of different parents) moved together in one solve.
+    // lanes: the dls problems through IKLanes, k_lanes frames per group.
+    constexpr int multiCount = 4;
+    struct Method {
+        const char* name; IKOptions::Method method; bool twoBone; int effectors;
+        bool lanes; QuatTracks::Isa isa;
+    };
+    std::vector<Method> methods = {
+        { "pseudoinverse", IKOptions::Method::Pseudoinverse,      false, 1,          false, QuatTracks::Isa::Scalar },
+        { "dls",           IKOptions::Method::DampedLeastSquares, false, 1,          false, QuatTracks::Isa::Scalar },
+        { "two-bone",      IKOptions::Method::DampedLeastSquares, true,  1,          false, QuatTracks::Isa::Scalar },
+        { "multi",         IKOptions::Method::DampedLeastSquares, false, multiCount, false, QuatTracks::Isa::Scalar },
+        { "lanes scalar",  IKOptions::Method::DampedLeastSquares, false, 1,          true,  QuatTracks::Isa::Scalar },
+    };
+    if (QuatTracks::bestIsa() >= QuatTracks::Isa::Sse2)
+        methods.push_back({ "lanes SSE2", IKOptions::Method::DampedLeastSquares, false, 1, true, QuatTracks::Isa::Sse2 });
+    if (QuatTracks::bestIsa() >= QuatTracks::Isa::Avx2)
+        methods.push_back({ "lanes AVX2", IKOptions::Method::DampedLeastSquares, false, 1, true, QuatTracks::Isa::Avx2 });
+
+    bool allocated = false;
+    for (int numJoints : jointCounts) {
+        for (const auto& m : methods) {
+            // Same skeleton, poses and targets for every method
+            std::mt19937 rng(1234);
+            std::shared_ptr<Skeleton> sk = makeSkeleton(numJoints, rng);
+
+            // Effector: the end of the longest chain
+            std::vector<int> depth(numJoints, 0);
+            int effector = 0;
+            for (int i = 1; i < numJoints; i++) {
+                depth[i] = depth[sk->parent[i]] + 1;
+                if (depth[i] > depth[effector]) effector = i;
+            }
+            if (m.twoBone) {
+                sk->limbEnd.assign(numJoints, 0);
+                sk->limbEnd[effector] = 1;
+            }
+            std::vector<int> leaves;
+            for (int i = 1; i < numJoints; i++)
+                if (sk->subtreeEnd[i] == i + 1) leaves.push_back(i);
+            std::stable_sort(leaves.begin(), leaves.end(), [&](int a, int b) { return depth[a] > depth[b]; });
+            // Leaves under one parent keep their distance, so take one per parent
+            std::vector<IKEffector> effectors;
+            for (int leaf : leaves) {
+                if ((int)effectors.size() == m.effectors) break;
+                if (std::none_of(effectors.begin(), effectors.end(),
+                                 [&](const IKEffector& e) { return sk->parent[e.joint] == sk->parent[leaf]; }))
+                    effectors.push_back({ leaf, glm::vec3(0) });
+            }
+            const int count = (int)effectors.size();
+
+            MotionClip clip;
+            clip.create(std::move(sk), frames);
+            randomPose(clip, rng);
+            clip.updateWorld(false);
+
+            // Targets a short reach from where the effector is
+            std::uniform_real_distribution<float> pick(-5.f, 5.f);
+            std::vector<glm::vec3> offsets((size_t)solves * count);
+            for (glm::vec3& o : offsets) o = glm::vec3(pick(rng), pick(rng), pick(rng));
+
+            if (&m == &methods[0])
+                std::cout << "[bench-ik] " << numJoints << " joints, chain of " << depth[effector]
+                          << " links, " << solves << " solves\n";
+
+            IKOptions options;
+            options.method  = m.method;
+            options.twoBone = m.twoBone;
+
+            // Targets for solve s, effector e: offsets[s * count + e]
+            auto solve = [&](Body body, int s) {
+                if (count == 1) return body.solveIK(effector, body.getPos(effector) + offsets[s], options);
+                for (int e = 0; e < count; e++)
+                    effectors[e].target = body.getPos(effectors[e].joint) + offsets[(size_t)s * count + e];
+                return body.solveIK(effectors, options);
+            };
+
+            // Lanes: solves [s, s + size) together; frames % k_lanes == 0
+            // keeps a group's frames distinct
+            IKLanes   lanes;
+            int       groupFrames[ik::k_lanes];
+            glm::vec3 groupTargets[ik::k_lanes];
+            IKStats   groupStats[ik::k_lanes];
+            auto solveGroup = [&](int s, int size) {
+                for (int k = 0; k < size; k++) {
+                    groupFrames[k]  = (s + k) % frames;
+                    groupTargets[k] = clip.worldP(effector, groupFrames[k]) + offsets[s + k];
+                }
+                lanes.solve(clip, effector, groupFrames, groupTargets, size, options, groupStats, m.isa);
+            };
+
+            // The first solve sizes the thread's solver; later ones must not allocate
+            if (m.lanes) solveGroup(0, 1);
+            else         solve(Body(clip, 0), 0);
+
+            double error = 0.0, iterations = 0.0, evaluations = 0.0;
+            int    converged = 0, closedForm = 0;
+            bool   sparse    = false;
+            auto add = [&](const IKStats& st) {
+                error       += st.error;
+                iterations  += st.iterations;
+                evaluations += st.evaluations;
+                converged   += st.converged;
+                closedForm  += st.twoBone;
+                sparse       = st.sparse;
+            };
+            const size_t allocations0 = g_heapAllocations.load();
+            EigenMallocGuard noEigenMalloc;
+            auto t0 = Clock::now();
+            for (int s = 0; s < solves;) {
+                if (!m.lanes) {
+                    add(solve(Body(clip, s % frames), s));
+                    s++;
+                    continue;
+                }
+                const int size = std::min(ik::k_lanes, solves - s);
+                solveGroup(s, size);
+                for (int k = 0; k < size; k++) add(groupStats[k]);
+                s += size;
+            }
+            const double sec         = secondsSince(t0);
+            const size_t allocations = g_heapAllocations.load() - allocations0;
+
+            std::cout << "  " << std::left << std::setw(16) << m.name << sec * 1e6 / solves << " us/solve, "
+                      << iterations / solves << " iterations, " << evaluations / solves << " FK evals, "
+                      << 100.0 * converged / solves << "% converged, mean error " << error / solves << ", "
+                      << allocations << " heap allocation(s)";
+            if (m.twoBone) std::cout << ", " << 100.0 * closedForm / solves << "% closed form";
+            if (count > 1) std::cout << ", " << count << " effectors, " << (sparse ? "sparse" : "dense") << " Jacobian";
+            std::cout << "\n";
+            allocated |= allocations > 0;
+        }
+    }
+
+    if (allocated) std::cerr << "[bench-ik] FAIL: the IK solver allocated on the heap\n";
+    return allocated ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// check-ik-alloc
+// ---------------------------------------------------------------------------
+
+int checkIKAlloc(int argc, char** argv) {
+    std::vector<int> jointCounts;
+    for (int i = 0; i < argc; i++) jointCounts.push_back(std::atoi(argv[i]));
+    if (jointCounts.empty()) jointCounts = { 31, 200 };
+    if (*std::min_element(jointCounts.begin(), jointCounts.end()) <= 1) {
+        std::cerr << "usage: MotionBatch check-ik-alloc [joints ...]\n";
+        return 1;
+    }
+
+    constexpr int frames = 16, solves = 64, multiCount = 4;
+    struct Method { const char* name; IKOptions::Method method; bool twoBone; int effectors; };
+    const Method methods[] = {
+        { "pseudoinverse", IKOptions::Method::Pseudoinverse,      false, 1          },
+        { "dls",           IKOptions::Method::DampedLeastSquares, false, 1          },
+        { "two-bone",      IKOptions::Method::DampedLeastSquares, true,  1          },
+        { "multi",         IKOptions::Method::DampedLeastSquares, false, multiCount },
+    };
+
+    bool allocated = false;
+    for (int numJoints : jointCounts) {
+        std::mt19937 rng(1234);
+        std::shared_ptr<Skeleton> sk = makeSkeleton(numJoints, rng);
+        std::vector<int> depth(numJoints, 0);
+        int effector = 0;
+        for (int i = 1; i < numJoints; i++) {
+            depth[i] = depth[sk->parent[i]] + 1;
+            if (depth[i] > depth[effector]) effector = i;
+        }
+        sk->limbEnd.assign(numJoints, 0);
+        sk->limbEnd[effector] = 1;   // only used with IKOptions::twoBone
+
+        // Multi: the deepest leaves, one per parent (as in bench-ik)
+        std::vector<int> leaves;
+        for (int i = 1; i < numJoints; i++)
+            if (sk->subtreeEnd[i] == i + 1) leaves.push_back(i);
+        std::stable_sort(leaves.begin(), leaves.end(), [&](int a, int b) { return depth[a] > depth[b]; });
+        std::vector<IKEffector> effectors;
+        for (int leaf : leaves) {
+            if ((int)effectors.size() == multiCount) break;
+            if (std::none_of(effectors.begin(), effectors.end(),
+                             [&](const IKEffector& e) { return sk->parent[e.joint] == sk->parent[leaf]; }))
+                effectors.push_back({ leaf, glm::vec3(0) });
+        }
+
+        std::uniform_real_distribution<float> pick(-5.f, 5.f);
+        std::vector<glm::vec3> offsets((size_t)solves * multiCount);
+        for (glm::vec3& o : offsets) o = glm::vec3(pick(rng), pick(rng), pick(rng));
+
+        for (const auto& m : methods) {
+            MotionClip clip;
+            clip.create(sk, frames);
+            randomPose(clip, rng);
+            clip.updateWorld(false);
+
+            IKOptions options;
+            options.method  = m.method;
+            options.twoBone = m.twoBone;
+
+            IKSolver solver;
+            solver.reserve(numJoints);
+            const int count = m.effectors > 1 ? (int)effectors.size() : 1;
+            auto solve = [&](int s) {
+                Body body(clip, s % frames);
+                if (count == 1) {
+                    solver.solve(body, effector, body.getPos(effector) + offsets[s], options);
+                    return;
+                }
+                for (int e = 0; e < count; e++)
+                    effectors[e].target = body.getPos(effectors[e].joint) + offsets[(size_t)s * count + e];
+                solver.solve(body, effectors.data(), count, options);
+            };
+            // Single target: reserved up front, so not even the first solve
+            // may allocate. Multi: the first solve on an effector set sizes
+            // its Eigen workspaces and sparsity pattern; later ones must not.
+            if (count > 1) solve(0);
+
+            const size_t allocations0 = g_heapAllocations.load();
+            {
+                EigenMallocGuard noEigenMalloc;
+                for (int s = 0; s < solves; s++) solve(s);
+            }
+            const size_t allocations = g_heapAllocations.load() - allocations0;
+
+            std::cout << "[check-ik-alloc] " << numJoints << " joints, " << std::left << std::setw(14) << m.name
+                      << allocations << " heap allocation(s) in " << solves << " solves";
+            if (count > 1) std::cout << " (" << count << " effectors, after one warm-up solve)";
+            std::cout << "\n";
+            allocated |= allocations > 0;
+        }
+    }
+
+    if (allocated) std::cerr << "[check-ik-alloc] FAIL: a reserved IKSolver allocated on the heap\n";
+    return allocated ? 1 : 0;
+}
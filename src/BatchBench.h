@@ -0,0 +1,37 @@
+//
+// BatchBench.h
+// ConstraintBasedMotionEdit
+//
+// Microbenchmarks and checks run by MotionBatch subcommands (MotionBatch
+// bench-..., check-...). Each takes the arguments after the subcommand name
+// and returns the process exit code.
+//
+
+#pragma once
+
+// bench-euler [joints] [frames]: Euler -> quaternion conversion, per-frame
+// kernels against the batch QuatTracks paths on a synthetic clip.
+int benchEuler(int argc, char** argv);
+
+// bench-fk [frames] [joints ...]: whole-clip forward kinematics, frame by
+// frame through Body::updatePos against the SIMD kernels of
+// MotionClip::updateWorld, on synthetic skeletons (default 31 and 200 joints).
+int benchFK(int argc, char** argv);
+
+// bench-ik [solves] [joints ...]: Body::solveIK with each IKOptions method,
+// with the two-bone path, four leaves in one multi-effector solve, and the
+// damped least-squares problems through IKLanes per ISA (eight frames per
+// group, against the dls row's solveIK loop), on synthetic skeletons
+// (default 31 and 200 joints; the single-target rows use the longest chain)
+// with random nearby targets; reports time,
+// iterations and convergence. Counts heap allocations during the solves and
+// fails (exit code 1) if there are any (Eigen's assert instead; see
+// check-ik-alloc).
+int benchIK(int argc, char** argv);
+
+// check-ik-alloc [joints ...]: a quick pass/fail run for CI. IKSolver::solve
+// with each method on a freshly reserved solver, and four effectors at once
+// after one warm-up solve, on synthetic skeletons (default 31 and 200
+// joints); exit code 1 if any solve allocated. Eigen allocations are caught
+// by EIGEN_RUNTIME_NO_MALLOC, which asserts in Debug builds only.
+int checkIKAlloc(int argc, char** argv);
@@ -0,0 +1,134 @@
+//
+// CompressedMotion.cpp
+// ConstraintBasedMotionEdit
+//
+// Smallest-three quaternion packing and keyframed root deltas.
+//
+
+#include "CompressedMotion.h"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr float k_invSqrt2 = 0.70710678f;
+static constexpr float k_maxQ     = 1023.f;    // 10-bit component range
+
+uint32_t CompressedMotion::packQuat(const glm::quat& qIn) {
+    glm::quat q = glm::normalize(qIn);
+    float c[4] = { q.x, q.y, q.z, q.w };
+
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+        if (std::fabs(c[i]) > std::fabs(c[largest])) largest = i;
+
+    // q and -q are the same rotation; make the dropped component positive
+    float sign = c[largest] < 0.f ? -1.f : 1.f;
+
+    uint32_t bits = (uint32_t)largest << 30;
+    int shift = 20;
+    for (int i = 0; i < 4; i++) {
+        if (i == largest) continue;
+        float v = std::clamp(sign * c[i], -k_invSqrt2, k_invSqrt2);
+        float u = (v / k_invSqrt2 * 0.5f + 0.5f) * k_maxQ;
+        bits |= (uint32_t)std::lround(u) << shift;
+        shift -= 10;
+    }
+    return bits;
+}
+
+glm::quat CompressedMotion::unpackQuat(uint32_t bits) {
+    int   largest = (int)(bits >> 30);
+    float c[4];
+    float sum   = 0.f;
+    int   shift = 20;
+    for (int i = 0; i < 4; i++) {
+        if (i == largest) continue;
+        float u = (float)((bits >> shift) & 0x3FF);
+        c[i]  = (u / k_maxQ * 2.f - 1.f) * k_invSqrt2;
+        sum  += c[i] * c[i];
+        shift -= 10;
+    }
+    c[largest] = std::sqrt(std::max(0.f, 1.f - sum));
+    return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+}
+
+void CompressedMotion::build(int numFrame, int numJoints, const std::vector<int>& tracks,
+                             int keyInterval, size_t rawBytes, const FrameFn& frameFn) {
+    m_numFrame    = numFrame;
+    m_numJoints   = numJoints;
+    m_keyInterval = std::max(keyInterval, 1);
+    m_tracks      = tracks;
+    m_stats       = Stats();
+
+    const int numTracks = (int)m_tracks.size();
+    const int numBlocks = (numFrame + m_keyInterval - 1) / m_keyInterval;
+    m_rotations.assign((size_t)numFrame * numTracks, 0);
+    m_rootKeys.assign(numBlocks, RootKey{ glm::vec3(0), 0.f });
+    m_rootDelta.assign((size_t)numFrame * 3, 0);
+
+    std::vector<glm::quat> rot(numJoints);
+    std::vector<glm::vec3> blockRoot(m_keyInterval);
+    double angleSum   = 0.0;
+    size_t angleCount = 0;
+
+    for (int b = 0; b < numBlocks; b++) {
+        const int first = b * m_keyInterval;
+        const int count = std::min(m_keyInterval, numFrame - first);
+
+        // Rotations: pack every frame, measure the error right away
+        for (int i = 0; i < count; i++) {
+            const int f = first + i;
+            frameFn(f, rot.data(), blockRoot[i]);
+            uint32_t* row = m_rotations.data() + (size_t)f * numTracks;
+            for (int t = 0; t < numTracks; t++) {
+                const glm::quat& exact = rot[m_tracks[t]];
+                row[t] = packQuat(exact);
+                float d   = std::fabs(glm::dot(glm::normalize(exact), unpackQuat(row[t])));
+                double deg = 2.0 * std::acos(std::min(d, 1.f)) * 180.0 / 3.14159265358979;
+                m_stats.maxAngleDeg = std::max(m_stats.maxAngleDeg, deg);
+                angleSum += deg;
+                angleCount++;
+            }
+        }
+
+        // Root: keyframe at the block start, int16 deltas scaled to the block's range
+        RootKey& key = m_rootKeys[b];
+        key.origin   = blockRoot[0];
+        float range  = 0.f;
+        for (int i = 0; i < count; i++)
+            for (int a = 0; a < 3; a++)
+                range = std::max(range, std::fabs(blockRoot[i][a] - key.origin[a]));
+        key.scale = range > 0.f ? range / 32767.f : 1.f;
+
+        for (int i = 0; i < count; i++) {
+            int16_t* d = m_rootDelta.data() + (size_t)(first + i) * 3;
+            for (int a = 0; a < 3; a++) {
+                float q = (blockRoot[i][a] - key.origin[a]) / key.scale;
+                d[a] = (int16_t)std::clamp(std::lround(q), -32767L, 32767L);
+                double err = std::fabs(key.origin[a] + d[a] * key.scale - blockRoot[i][a]);
+                m_stats.maxRootError = std::max(m_stats.maxRootError, err);
+            }
+        }
+    }
+
+    m_stats.meanAngleDeg = angleCount ? angleSum / angleCount : 0.0;
+    m_stats.rawBytes     = rawBytes;
+    m_stats.packedBytes  = m_rotations.size() * sizeof(uint32_t)
+                         + m_rootKeys.size()  * sizeof(RootKey)
+                         + m_rootDelta.size() * sizeof(int16_t)
+                         + m_tracks.size()    * sizeof(int);
+}
+
+void CompressedMotion::decode(int f, glm::quat* rotations, glm::vec3& rootPos) const {
+    const int numTracks = (int)m_tracks.size();
+
+    for (int j = 0; j < m_numJoints; j++)
+        rotations[j] = glm::quat(1, 0, 0, 0);
+    const uint32_t* row = m_rotations.data() + (size_t)f * numTracks;
+    for (int t = 0; t < numTracks; t++)
+        rotations[m_tracks[t]] = unpackQuat(row[t]);
+
+    const RootKey& key = m_rootKeys[f / m_keyInterval];
+    const int16_t* d   = m_rootDelta.data() + (size_t)f * 3;
+    rootPos = key.origin + glm::vec3(d[0], d[1], d[2]) * key.scale;
+}
@@ -0,0 +1,66 @@
+//
+// CompressedMotion.h
+// ConstraintBasedMotionEdit
+//
+// Quantized in-memory motion store with constant-time frame decode.
+//   - joint rotations: smallest-three quaternions packed into 32 bits
+//     (2-bit index of the dropped component + 3 x 10-bit components)
+//   - root translation: float keyframe every keyInterval frames plus
+//     per-frame int16 deltas from that keyframe, scaled per block
+// Decoding frame f touches one rotation row and one keyframe block,
+// independent of f.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class CompressedMotion {
+public:
+    struct Stats {
+        size_t rawBytes      = 0;     // source channel data (doubles)
+        size_t packedBytes   = 0;
+        double maxAngleDeg   = 0.0;   // worst joint rotation error
+        double meanAngleDeg  = 0.0;
+        double maxRootError  = 0.0;   // worst root translation error (BVH units)
+
+        double Ratio() const { return packedBytes ? (double)rawBytes / packedBytes : 0.0; }
+    };
+
+    // Fills rotations[numJoints] and rootPos with the exact pose of frame f.
+    using FrameFn = std::function<void(int f, glm::quat* rotations, glm::vec3& rootPos)>;
+
+    // tracks lists the joints whose rotation varies; all others decode as
+    // identity. rawBytes is only used for the reported ratio.
+    void build(int numFrame, int numJoints, const std::vector<int>& tracks,
+               int keyInterval, size_t rawBytes, const FrameFn& frameFn);
+
+    void decode(int f, glm::quat* rotations, glm::vec3& rootPos) const;
+
+    bool         empty()     const { return m_numFrame == 0; }
+    int          numFrame()  const { return m_numFrame; }
+    int          numJoints() const { return m_numJoints; }
+    const Stats& stats()     const { return m_stats; }
+
+    static uint32_t  packQuat(const glm::quat& q);
+    static glm::quat unpackQuat(uint32_t bits);
+
+private:
+    struct RootKey {
+        glm::vec3 origin;   // root position at the block's first frame
+        float     scale;    // delta units per int16 step
+    };
+
+    int                   m_numFrame    = 0;
+    int                   m_numJoints   = 0;
+    int                   m_keyInterval = 1;
+    std::vector<int>      m_tracks;     // joint index per packed rotation column
+    std::vector<uint32_t> m_rotations;  // [frame * tracks + t]
+    std::vector<RootKey>  m_rootKeys;   // [frame / keyInterval]
+    std::vector<int16_t>  m_rootDelta;  // [frame * 3 + axis]
+    Stats                 m_stats;
+};
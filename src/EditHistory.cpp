@@ -0,0 +1,209 @@
+//
+// EditHistory.cpp
+// ConstraintBasedMotionEdit
+//
+// Recording and replaying the undo / redo deltas of an edit layer.
+//
+
+#include "EditHistory.h"
+
+#include <set>
+
+static bool sameTrack(const DisplacementTrack& a, const DisplacementTrack& b) {
+    return a.space == b.space && a.controlN == b.controlN && a.control == b.control;
+}
+
+// ---------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------
+
+void EditHistory::beginFrameEdit(const MotionClip& clip, int f) {
+    if (inFrameEdit()) endFrameEdit(clip);
+
+    m_open = FrameEdit();
+    m_open.frame       = f;
+    m_open.hadOverride = clip.overrideRow(f) != nullptr;
+    m_openPose.resize(clip.numLinks());
+    for (int i = 0; i < clip.numLinks(); i++)
+        m_openPose[i] = clip.localQ(i, f);
+
+    auto it = clip.displacements().find(f);
+    m_open.hadDisp = it != clip.displacements().end();
+    if (m_open.hadDisp) m_open.dispBefore = it->second;
+}
+
+void EditHistory::endFrameEdit(const MotionClip& clip) {
+    if (!inFrameEdit()) return;
+    Step step;
+    step.frame = std::move(m_open);
+    m_open     = FrameEdit();
+
+    FrameEdit& e = step.frame;
+    for (int i = 0; i < clip.numLinks(); i++) {
+        const glm::quat q = clip.localQ(i, e.frame);
+        if (q == m_openPose[i]) continue;
+        e.links.push_back(i);
+        e.before.push_back(m_openPose[i]);
+        e.after.push_back(q);
+    }
+
+    auto it = clip.displacements().find(e.frame);
+    e.hasDisp = it != clip.displacements().end();
+    if (e.hasDisp) e.dispAfter = it->second;
+
+    if (e.links.empty() && e.hadDisp == e.hasDisp && e.dispBefore == e.dispAfter) return;
+    step.name = "drag frame " + std::to_string(e.frame);
+    push(std::move(step));
+}
+
+void EditHistory::beginLayerEdit(const MotionClip& clip) {
+    if (inFrameEdit()) endFrameEdit(clip);
+
+    // Every override may be dropped; keep them all until the edit ends
+    m_openLayer = true;
+    m_openEdit  = LayerEdit();
+    m_openEdit.trackBefore = shareTrack(clip.displacementTrack());
+    m_openEdit.dispBefore  = clip.displacements();
+    m_openOverrides.clear();
+    for (int f = 0; f < clip.numFrames(); f++) {
+        const glm::quat* row = clip.overrideRow(f);
+        if (!row) continue;
+        m_openOverrides.push_back(f);
+        m_openEdit.droppedRows.insert(m_openEdit.droppedRows.end(), row, row + clip.numLinks());
+    }
+}
+
+void EditHistory::endLayerEdit(const MotionClip& clip, const char* name) {
+    if (!m_openLayer) return;
+    m_openLayer = false;
+    Step step;
+    step.layer = true;
+    step.edit  = std::move(m_openEdit);
+    m_openEdit = LayerEdit();
+
+    // Keep only the overrides that are gone now
+    LayerEdit&   e = step.edit;
+    const size_t n = clip.numLinks();
+    std::vector<glm::quat> rows;
+    for (size_t k = 0; k < m_openOverrides.size(); k++) {
+        if (clip.overrideRow(m_openOverrides[k])) continue;
+        e.dropped.push_back(m_openOverrides[k]);
+        rows.insert(rows.end(), e.droppedRows.begin() + k * n, e.droppedRows.begin() + (k + 1) * n);
+    }
+    e.droppedRows.swap(rows);
+    e.trackAfter = sameTrack(*e.trackBefore, clip.displacementTrack())
+                 ? e.trackBefore
+                 : std::make_shared<const DisplacementTrack>(clip.displacementTrack());
+    e.dispAfter  = clip.displacements();
+
+    if (e.trackAfter == e.trackBefore && e.dropped.empty() && e.dispBefore == e.dispAfter) return;
+    step.name = name;
+    push(std::move(step));
+}
+
+void EditHistory::push(Step step) {
+    m_steps.resize(m_current);
+    m_steps.push_back(std::move(step));
+    m_current++;
+}
+
+EditHistory::TrackPtr EditHistory::shareTrack(const DisplacementTrack& track) const {
+    // Frame edits leave the track alone, so the newest layer step's result
+    // is usually the track the next one starts from
+    for (int k = m_current - 1; k >= 0; k--) {
+        if (!m_steps[k].layer) continue;
+        if (sameTrack(*m_steps[k].edit.trackAfter, track)) return m_steps[k].edit.trackAfter;
+        break;
+    }
+    return std::make_shared<const DisplacementTrack>(track);
+}
+
+void EditHistory::clear() {
+    std::vector<Step>().swap(m_steps);
+    m_current   = 0;
+    m_open      = FrameEdit();
+    m_openLayer = false;
+    m_openEdit  = LayerEdit();
+    m_openOverrides.clear();
+}
+
+size_t EditHistory::bytes() const {
+    const size_t disp = sizeof(glm::vec3);
+    auto mapBytes = [&](const std::map<int, Displacement>& m) {
+        size_t b = 0;
+        for (const auto& kv : m) b += sizeof(kv) + kv.second.size() * disp;
+        return b;
+    };
+
+    size_t b = m_steps.size() * sizeof(Step);
+    std::set<const DisplacementTrack*> tracks;
+    for (const Step& s : m_steps) {
+        b += s.name.size();
+        if (!s.layer) {
+            const FrameEdit& e = s.frame;
+            b += e.links.size() * (sizeof(int) + 2 * sizeof(glm::quat));
+            b += (e.dispBefore.size() + e.dispAfter.size()) * disp;
+            continue;
+        }
+        const LayerEdit& e = s.edit;
+        for (const DisplacementTrack* t : { e.trackBefore.get(), e.trackAfter.get() })
+            if (tracks.insert(t).second) b += sizeof(*t) + t->control.size() * sizeof(glm::vec3);
+        b += e.dropped.size() * sizeof(int) + e.droppedRows.size() * sizeof(glm::quat);
+        b += mapBytes(e.dispBefore) + mapBytes(e.dispAfter);
+    }
+    return b;
+}
+
+// ---------------------------------------------------------------------------
+// Replay
+// ---------------------------------------------------------------------------
+
+bool EditHistory::undo(MotionClip& clip) {
+    if (inFrameEdit()) endFrameEdit(clip);
+    if (m_current == 0) return false;
+    const Step& s = m_steps[--m_current];
+
+    if (s.layer) {
+        const LayerEdit& e = s.edit;
+        const size_t     n = clip.numLinks();
+        clip.setDisplacementTrack(*e.trackBefore, false);
+        for (size_t k = 0; k < e.dropped.size(); k++)
+            clip.setOverrideRow(e.dropped[k], e.droppedRows.data() + k * n);
+        clip.setDisplacements(e.dispBefore);
+        return true;
+    }
+
+    const FrameEdit& e = s.frame;
+    if (!e.hadOverride)
+        clip.setOverrideRow(e.frame, nullptr);
+    else
+        for (size_t k = 0; k < e.links.size(); k++)
+            clip.setLocalQ(e.links[k], e.frame, e.before[k]);
+    if (e.hadDisp) clip.displacement(e.frame) = e.dispBefore;
+    else           clip.eraseDisplacement(e.frame);
+    return true;
+}
+
+bool EditHistory::redo(MotionClip& clip) {
+    if (inFrameEdit()) endFrameEdit(clip);
+    if (m_current == (int)m_steps.size()) return false;
+    const Step& s = m_steps[m_current++];
+
+    if (s.layer) {
+        const LayerEdit& e = s.edit;
+        clip.setDisplacementTrack(*e.trackAfter, false);
+        for (int f : e.dropped)
+            clip.setOverrideRow(f, nullptr);
+        clip.setDisplacements(e.dispAfter);
+        return true;
+    }
+
+    // A frame without an override is copied from its current pose first,
+    // which is the pose the drag started from
+    const FrameEdit& e = s.frame;
+    for (size_t k = 0; k < e.links.size(); k++)
+        clip.setLocalQ(e.links[k], e.frame, e.after[k]);
+    if (e.hasDisp) clip.displacement(e.frame) = e.dispAfter;
+    else           clip.eraseDisplacement(e.frame);
+    return true;
+}
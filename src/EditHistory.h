@@ -0,0 +1,92 @@
+//
+// EditHistory.h
+// ConstraintBasedMotionEdit
+//
+// Undo / redo for an edit layer (MotionClip::createLayer). Each step is a
+// delta, not a copy of the clip:
+//   - a frame edit (one IK drag) keeps the links whose rotation changed,
+//     before and after, and the frame's displacement (its constraint);
+//   - a layer edit (motionEdit, reset) keeps the displacement track before
+//     and after, the overrides it dropped and the constraint set it consumed.
+// So memory grows with what was edited, and stepping through history costs
+// the size of the step; the clip's dirty tracking recomputes only the frames
+// a step touched. History is linear: recording a step drops the redo side.
+//
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "MotionClip.h"
+
+class EditHistory {
+public:
+    // Brackets one drag of frame f; end records it if any link changed.
+    // A frame edit still open when another begins is ended first.
+    void beginFrameEdit(const MotionClip& clip, int f);
+    void endFrameEdit(const MotionClip& clip);
+    bool inFrameEdit() const { return m_open.frame >= 0; }
+    int  editFrame()   const { return m_open.frame; }
+
+    // Brackets an edit of the whole layer (motionEdit, resetLayer); end
+    // records it, labelled name, if the layer changed.
+    void beginLayerEdit(const MotionClip& clip);
+    void endLayerEdit(const MotionClip& clip, const char* name);
+
+    // Step clip back / forward; false when there is nothing to step to.
+    // clip must be the layer the steps were recorded on.
+    bool undo(MotionClip& clip);
+    bool redo(MotionClip& clip);
+    void clear();
+
+    int         numUndo()  const { return m_current; }
+    int         numRedo()  const { return (int)m_steps.size() - m_current; }
+    const char* undoName() const { return m_current > 0 ? m_steps[m_current - 1].name.c_str() : ""; }
+    const char* redoName() const { return numRedo() > 0 ? m_steps[m_current].name.c_str() : ""; }
+    // Memory held by the recorded steps (tracks shared between steps once)
+    size_t      bytes()    const;
+
+private:
+    using Displacement = std::vector<glm::vec3>;
+    using TrackPtr     = std::shared_ptr<const DisplacementTrack>;
+
+    struct FrameEdit {
+        int                    frame       = -1;
+        bool                   hadOverride = false;
+        std::vector<int>       links;            // changed links
+        std::vector<glm::quat> before, after;    // [k] for links[k]
+        bool                   hadDisp = false, hasDisp = false;
+        Displacement           dispBefore, dispAfter;
+    };
+    struct LayerEdit {
+        TrackPtr               trackBefore, trackAfter;
+        std::vector<int>       dropped;          // frames whose override the edit dropped
+        std::vector<glm::quat> droppedRows;      // [k * numLinks + link]
+        std::map<int, Displacement> dispBefore, dispAfter;
+    };
+    struct Step {
+        std::string name;
+        bool        layer = false;
+        FrameEdit   frame;
+        LayerEdit   edit;
+    };
+
+    std::vector<Step> m_steps;
+    int               m_current = 0;   // steps [0, m_current) are applied
+
+    // Open edits: the frame's pose / the layer's state when it began
+    FrameEdit              m_open;
+    std::vector<glm::quat> m_openPose;
+    bool                   m_openLayer = false;
+    LayerEdit              m_openEdit;
+    std::vector<int>       m_openOverrides;
+
+    void push(Step step);
+    // track, shared with the newest recorded step when equal
+    TrackPtr shareTrack(const DisplacementTrack& track) const;
+};
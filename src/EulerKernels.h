@@ -0,0 +1,186 @@
+//
+// EulerKernels.h
+// ConstraintBasedMotionEdit
+//
+// Euler channels -> local quaternion, one kernel per rotation order.
+// A joint's order is resolved once at load (select) into a function
+// specialized on its axes, so posing a frame does no per-channel branching:
+// each kernel is the closed-form product of the half-angle axis rotations
+// q = R_i(a) R_j(b) R_k(c), with the axis indices as template parameters.
+//
+// The compose formulas are templated on the number type as well, so the
+// batch converter (QuatTracks) runs the same algebra on SIMD lanes.
+//
+
+#pragma once
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace euler {
+
+// data: one frame of channels; channel[s] / axis[s]: channel index and axis
+// (0 = X, 1 = Y, 2 = Z) of the s-th rotation channel in file order.
+using Kernel = glm::quat (*)(const double* data, const int* channel, const int* axis);
+
+constexpr float k_halfDegToRad = 3.14159265f / 180.f / 2.f;
+
+// Half-angle cosine and sine of a channel value in degrees (float, as before).
+inline void halfAngle(double deg, float& c, float& s) {
+    float h = (float)deg * k_halfDegToRad;
+    c = std::cos(h);
+    s = std::sin(h);
+}
+
+// +1 when (i, j, k) is a cyclic permutation of (X, Y, Z), -1 otherwise.
+constexpr float parity(int i, int j) { return (j - i + 3) % 3 == 1 ? 1.f : -1.f; }
+
+// ---------------------------------------------------------------------------
+// Rotation orders: compose(c, s, axis, w, v) turns the half-angle cosines and
+// sines of the rotation channels into q = (w, v). T is float or a SIMD type.
+// ---------------------------------------------------------------------------
+
+struct Order0 {
+    static constexpr int count = 0;
+    template <class T>
+    static void compose(const T*, const T*, const int*, T& w, T* v) {
+        w = T(1.f);
+        v[0] = v[1] = v[2] = T(0.f);
+    }
+};
+
+template <int I>
+struct Order1 {
+    static constexpr int count = 1;
+    template <class T>
+    static void compose(const T* c, const T* s, const int*, T& w, T* v) {
+        w = c[0];
+        v[0] = v[1] = v[2] = T(0.f);
+        v[I] = s[0];
+    }
+};
+
+// R_i R_j: the missing axis k only picks up the cross term
+template <int I, int J>
+struct Order2 {
+    static constexpr int count = 2;
+    template <class T>
+    static void compose(const T* c, const T* s, const int*, T& w, T* v) {
+        constexpr int   K = 3 - I - J;
+        constexpr float e = parity(I, J);
+        w    = c[0] * c[1];
+        v[I] = s[0] * c[1];
+        v[J] = c[0] * s[1];
+        v[K] = e * (s[0] * s[1]);
+    }
+};
+
+// R_i R_j R_k for a Tait-Bryan order
+template <int I, int J, int K>
+struct Order3 {
+    static constexpr int count = 3;
+    template <class T>
+    static void compose(const T* c, const T* s, const int*, T& w, T* v) {
+        constexpr float e = parity(I, J);
+        const T cc = c[0] * c[1], ss = s[0] * s[1], sc = s[0] * c[1], cs = c[0] * s[1];
+        w    = cc * c[2] - e * (ss * s[2]);
+        v[I] = sc * c[2] + e * (cs * s[2]);
+        v[J] = cs * c[2] - e * (sc * s[2]);
+        v[K] = cc * s[2] + e * (ss * c[2]);
+    }
+};
+
+// Repeated axes (e.g. Z X Z): plain product, reads the axes at run time
+template <int N>
+struct OrderAny {
+    static constexpr int count = N;
+    template <class T>
+    static void compose(const T* c, const T* s, const int* axis, T& w, T* v) {
+        w = T(1.f);
+        v[0] = v[1] = v[2] = T(0.f);
+        for (int i = 0; i < N; i++) {
+            // q * (c, s e_a)
+            const int a = axis[i], b = (a + 1) % 3, d = (a + 2) % 3;
+            T nw  = w * c[i] - v[a] * s[i];
+            T na  = v[a] * c[i] + w * s[i];
+            T nb  = v[b] * c[i] + v[d] * s[i];
+            T nd  = v[d] * c[i] - v[b] * s[i];
+            w = nw; v[a] = na; v[b] = nb; v[d] = nd;
+        }
+    }
+};
+
+// Calls fn(Order{}) with the order type for 'count' (<= 3) rotation axes.
+template <class Fn>
+auto withOrder(const int* axis, int count, Fn&& fn) {
+    switch (count) {
+    case 0: return fn(Order0{});
+    case 1: return axis[0] == 0 ? fn(Order1<0>{}) : axis[0] == 1 ? fn(Order1<1>{}) : fn(Order1<2>{});
+    case 2:
+        switch (axis[0] * 3 + axis[1]) {
+        case 1: return fn(Order2<0, 1>{});
+        case 2: return fn(Order2<0, 2>{});
+        case 3: return fn(Order2<1, 0>{});
+        case 5: return fn(Order2<1, 2>{});
+        case 6: return fn(Order2<2, 0>{});
+        case 7: return fn(Order2<2, 1>{});
+        default: return fn(OrderAny<2>{});
+        }
+    default:
+        switch (axis[0] * 9 + axis[1] * 3 + axis[2]) {
+        case  5: return fn(Order3<0, 1, 2>{});   // XYZ
+        case  7: return fn(Order3<0, 2, 1>{});   // XZY
+        case 11: return fn(Order3<1, 0, 2>{});   // YXZ
+        case 15: return fn(Order3<1, 2, 0>{});   // YZX
+        case 19: return fn(Order3<2, 0, 1>{});   // ZXY
+        case 21: return fn(Order3<2, 1, 0>{});   // ZYX
+        default: return fn(OrderAny<3>{});
+        }
+    }
+}
+
+template <class Order>
+glm::quat rotate(const double* data, const int* channel, const int* axis) {
+    float c[3], s[3], w, v[3];
+    for (int i = 0; i < Order::count; i++)
+        halfAngle(data[channel[i]], c[i], s[i]);
+    Order::compose(c, s, axis, w, v);
+    return glm::quat(w, v[0], v[1], v[2]);
+}
+
+// Batch form: frames [f0, f1) of frame-major channel data (numChannel per
+// row) into four component planes, V::width frames at a time. The tail runs
+// through the one-lane type Lane1, so every frame uses the same arithmetic.
+template <class V, class Lane1, class Order>
+void convertFrames(const double* motion, int numChannel, const int* channel, const int* axis,
+                   int f0, int f1, float* w, float* x, float* y, float* z) {
+    int f = f0;
+    for (; f + V::width <= f1; f += V::width) {
+        const double* row = motion + (size_t)f * numChannel;
+        V c[3], s[3], qw, qv[3];
+        for (int i = 0; i < Order::count; i++)
+            sincos(k_halfDegToRad * V::gather(row + channel[i], numChannel), s[i], c[i]);
+        Order::compose(c, s, axis, qw, qv);
+        qw.store(w + f);
+        qv[0].store(x + f);
+        qv[1].store(y + f);
+        qv[2].store(z + f);
+    }
+    if constexpr (V::width > 1) {
+        if (f < f1) convertFrames<Lane1, Lane1, Order>(motion, numChannel, channel, axis, f, f1, w, x, y, z);
+    }
+}
+
+inline glm::quat identity(const double*, const int*, const int*) {
+    return glm::quat(1, 0, 0, 0);
+}
+
+// Kernel for 'count' (<= 3) rotation channels with the given axes.
+inline Kernel select(const int* axis, int count) {
+    return withOrder(axis, count, [](auto order) -> Kernel {
+        return &rotate<decltype(order)>;
+    });
+}
+
+} // namespace euler
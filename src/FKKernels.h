@@ -0,0 +1,87 @@
+//
+// FKKernels.h
+// ConstraintBasedMotionEdit
+//
+// Forward kinematics of one link over a run of frames, on SoA planes:
+//   worldP = parentQ * offset + parentP
+//   worldQ = parentQ * localQ
+// with the same operation order as glm's quat * vec3 and quat * quat, so the
+// scalar lane reproduces the glm results. forwardFrames walks the frames
+// V::width at a time and finishes the tail with Lane1. MotionClip calls it
+// per link in topological order (parents first).
+//
+
+#pragma once
+
+#include "SimdMath.h"
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+namespace fk {
+
+// Planes of one link, starting at the first frame of the run:
+// p = position (x, y, z), q = rotation (w, x, y, z).
+struct ConstPlanes {
+    const float* p[3];
+    const float* q[4];
+};
+struct Planes {
+    float* p[3];
+    float* q[4];
+};
+
+// Planes of one link in a world store of seven planes (px, py, pz, qw, qx,
+// qy, qz) of planeSize floats each, starting at element i.
+inline Planes worldPlanes(float* w, size_t planeSize, size_t i) {
+    w += i;
+    return { { w, w + planeSize, w + 2 * planeSize },
+             { w + 3 * planeSize, w + 4 * planeSize, w + 5 * planeSize, w + 6 * planeSize } };
+}
+inline ConstPlanes worldPlanes(const float* w, size_t planeSize, size_t i) {
+    w += i;
+    return { { w, w + planeSize, w + 2 * planeSize },
+             { w + 3 * planeSize, w + 4 * planeSize, w + 5 * planeSize, w + 6 * planeSize } };
+}
+
+template <class V>
+inline void forwardStep(const ConstPlanes& parent, const float* const local[4],
+                        const glm::vec3& offset, const Planes& world, int i) {
+    const V pw = V::load(parent.q[0] + i), px = V::load(parent.q[1] + i);
+    const V py = V::load(parent.q[2] + i), pz = V::load(parent.q[3] + i);
+    const V ox(offset.x), oy(offset.y), oz(offset.z), two(2.f);
+
+    // uv = cross(q.xyz, offset), uuv = cross(q.xyz, uv)
+    const V uvx = py * oz - oy * pz;
+    const V uvy = pz * ox - oz * px;
+    const V uvz = px * oy - ox * py;
+    const V uuvx = py * uvz - uvy * pz;
+    const V uuvy = pz * uvx - uvz * px;
+    const V uuvz = px * uvy - uvx * py;
+    (ox + ((uvx * pw) + uuvx) * two + V::load(parent.p[0] + i)).store(world.p[0] + i);
+    (oy + ((uvy * pw) + uuvy) * two + V::load(parent.p[1] + i)).store(world.p[1] + i);
+    (oz + ((uvz * pw) + uuvz) * two + V::load(parent.p[2] + i)).store(world.p[2] + i);
+
+    const V lw = V::load(local[0] + i), lx = V::load(local[1] + i);
+    const V ly = V::load(local[2] + i), lz = V::load(local[3] + i);
+    (pw * lw - px * lx - py * ly - pz * lz).store(world.q[0] + i);
+    (pw * lx + px * lw + py * lz - pz * ly).store(world.q[1] + i);
+    (pw * ly + py * lw + pz * lx - px * lz).store(world.q[2] + i);
+    (pw * lz + pz * lw + px * ly - py * lx).store(world.q[3] + i);
+}
+
+template <class V, class Lane1>
+inline void forwardFrames(const ConstPlanes& parent, const float* const local[4],
+                          const glm::vec3& offset, const Planes& world, int n) {
+    int i = 0;
+    for (; i + V::width <= n; i += V::width) forwardStep<V>(parent, local, offset, world, i);
+    for (; i < n; i++)                       forwardStep<Lane1>(parent, local, offset, world, i);
+}
+
+// AVX2 instantiation (FKKernelsAvx2.cpp, built with AVX2 code generation
+// like QuatTracksAvx2.cpp); runs the SSE2 kernel when the build has none.
+// Callers check simd::hasAvx2() first (QuatTracks::bestIsa).
+void forwardFramesAvx2(const ConstPlanes& parent, const float* const local[4],
+                       const glm::vec3& offset, const Planes& world, int n);
+
+} // namespace fk
@@ -0,0 +1,21 @@
+//
+// FKKernelsAvx2.cpp
+// ConstraintBasedMotionEdit
+//
+// AVX2 instantiation of the FK kernel. This file alone is built with
+// /arch:AVX2 (see the vcxproj), like QuatTracksAvx2.cpp; MotionClip only
+// picks it when QuatTracks::bestIsa() reports AVX2.
+//
+
+#include "FKKernels.h"
+
+void fk::forwardFramesAvx2(const ConstPlanes& parent, const float* const local[4],
+                           const glm::vec3& offset, const Planes& world, int n) {
+#if defined(SIMD_X64) && defined(__AVX2__)
+    forwardFrames<simd::Avx8, simd::Float1>(parent, local, offset, world, n);
+#elif defined(SIMD_X64)
+    forwardFrames<simd::Sse4, simd::Float1>(parent, local, offset, world, n);
+#else
+    forwardFrames<simd::Float1, simd::Float1>(parent, local, offset, world, n);
+#endif
+}
@@ -2,143 +2,641 @@
 // IK.cpp
 // ConstraintBasedMotionEdit
 //
-// Link rendering and Body IK solver implementation.
+// Body rendering and IK solver implementation.
 //
 
 #include "IK.h"
+#include "IKKernels.h"
 
-// ---------------------------------------------------------------------------
-// Link
-// ---------------------------------------------------------------------------
-
-void Link::render() const {
-    drawSphere(getPos(), 1.f);
-    drawSphere(m_parentGlobalP, 1.f);
-    drawCylinder(getPos(), m_parentGlobalP, 0.8f);
-}
+#include <algorithm>
 
-void Link::shapeRender() const {
-    drawCylinder(getPos(), m_parentGlobalP, 0.1f);
+// Local rotation of a link whose parent has world rotation parentW after its
+// world rotation is turned by r (about the link's joint)
+static glm::quat turnLocal(const glm::quat& parentW, const glm::quat& r, const glm::quat& local) {
+    return glm::normalize(glm::inverse(parentW) * r * parentW * local);
 }
 
 // ---------------------------------------------------------------------------
 // Body
 // ---------------------------------------------------------------------------
 
-void Body::clear() {
-    links.clear();
-    globalP = glm::vec3(0);
-    globalQ = glm::quat(1, 0, 0, 0);
+void Body::render() const {
+    for (int i = 0; i < numLinks(); i++) {
+        if (parentIndex(i) < 0) continue;
+        glm::vec3 pos = getPos(i), parentPos = getPos(parentIndex(i));
+        drawSphere(pos, 1.f);
+        drawSphere(parentPos, 1.f);
+        drawCylinder(pos, parentPos, 0.8f);
+    }
 }
 
-void Body::add(int parI, int chiI,
-               const glm::vec3& ll, const glm::quat& qq,
-               const glm::vec3& pl, const glm::quat& pq,
-               bool end) {
-    links.emplace_back(parI, chiI, ll, qq, pl, pq, end);
+void Body::shapeRender() const {
+    for (int i = 0; i < numLinks(); i++)
+        if (parentIndex(i) >= 0)
+            drawCylinder(getPos(i), getPos(parentIndex(i)), 0.1f);
 }
 
-void Body::render() const {
-    for (const auto& link : links)
-        if (link.parentIndex >= 0)
-            link.render();
+static IKSolver& threadSolver() {
+    thread_local IKSolver solver;
+    return solver;
 }
 
-void Body::shapeRender() const {
-    for (const auto& link : links)
-        if (link.parentIndex >= 0)
-            link.shapeRender();
+IKStats Body::solveIK(int target, const glm::vec3& targetP, const IKOptions& options) {
+    return threadSolver().solve(*this, target, targetP, options);
+}
+
+IKStats Body::solveIK(const std::vector<IKEffector>& effectors, const IKOptions& options) {
+    return threadSolver().solve(*this, effectors.data(), (int)effectors.size(), options);
 }
 
-void Body::updatePos(int condition) {
-    int start = 1, end = (int)links.size();
-    if      (condition == 1) { start = 1;  end = 7;  }
-    else if (condition == 2) { start = 7;  end = 13; }
-    else if (condition == 3) { start = 13; end = (int)links.size(); }
+void Body::getDisplacement() {
+    const MotionClip& origin = clip->isLayer() ? *clip->base() : *clip;
+    std::vector<glm::vec3>& d = clip->displacement(frame);
 
-    for (int i = start; i < end; i++) {
-        const Link& parent = links[links[i].parentIndex];
-        links[i].updatePose(parent.getPos(), parent.getOri());
+    // Root translation displacement (in local frame of origin root)
+    const glm::quat rootQ = origin.localQ(0, frame);
+    d[0] = glm::inverse(rootQ) * (getPos(0) - origin.rootPos(frame)) * rootQ;
+
+    // Per-joint orientation displacement via quaternion log-map
+    for (int i = 1; i < numLinks() + 1; i++) {
+        glm::quat dq = glm::log(glm::inverse(origin.localQ(i - 1, frame)) * q(i - 1));
+        d[i] = glm::vec3(dq.x, dq.y, dq.z);
     }
 }
 
-std::vector<int> Body::getAncestors(int end) const {
-    std::vector<int> result;
-    int idx = end;
-    while (links[idx].parentIndex != -1) {
-        result.push_back(links[idx].parentIndex);
-        idx = links[idx].parentIndex;
+// ---------------------------------------------------------------------------
+// IKSolver
+// ---------------------------------------------------------------------------
+
+void IKSolver::reserve(int numLinks) {
+    m_chain.reserve(numLinks);
+    if (m_jacobian.size() < (size_t)9 * numLinks) m_jacobian.resize((size_t)9 * numLinks);
+    if (m_local.size()    < (size_t)numLinks)     m_local.resize(numLinks);
+    if (m_trial.size()    < (size_t)numLinks)     m_trial.resize(numLinks);
+    if (m_worldP.size()   < (size_t)numLinks)     m_worldP.resize(numLinks);
+    if (m_worldQ.size()   < (size_t)numLinks)     m_worldQ.resize(numLinks);
+    if (m_slot.size()     < (size_t)numLinks)     m_slot.resize(numLinks);
+    m_joints.reserve(numLinks);
+}
+
+glm::vec3 IKSolver::forwardChain(Body body, const glm::quat* local) {
+    // Same operation order as the clip's FK (FKKernels.h)
+    for (int k = (int)m_chain.size() - 2; k >= 0; k--) {
+        m_worldP[k] = m_worldP[k + 1] + m_worldQ[k + 1] * body.l(m_chain[k]);
+        m_worldQ[k] = m_worldQ[k + 1] * local[k];
+    }
+    return m_worldP[0] + m_worldQ[0] * m_offset;
+}
+
+IKStats IKSolver::solve(Body body, int target, const glm::vec3& targetP, const IKOptions& options) {
+    IKStats stats;
+    m_chain.clear();
+    for (int i = body.parentIndex(target); i >= 0; i = body.parentIndex(i))
+        m_chain.push_back(i);
+    if (m_chain.empty()) {
+        stats.error     = glm::length(targetP - body.getPos(target));
+        stats.converged = stats.error <= options.tolerance;
+        return stats;
     }
-    return result;
+    reserve(body.numLinks());
+
+    // The root's world transform is its local one, and it never moves
+    const int n = (int)m_chain.size();
+    for (int k = 0; k < n; k++) m_local[k] = body.q(m_chain[k]);
+    m_worldP[n - 1] = body.l(0);
+    m_worldQ[n - 1] = m_local[n - 1];
+    m_offset        = body.l(target);
+
+    const std::vector<uint8_t>& limbEnd = body.clip->skeleton().limbEnd;
+    const bool limb   = options.twoBone && !limbEnd.empty() && limbEnd[target];
+    const bool solved = limb && solveTwoBone(body, targetP, options, stats);
+    if (!solved && options.method == IKOptions::Method::Pseudoinverse)
+        solvePseudoinverse(body, target, targetP, options, stats);
+    else if (!solved)
+        solveDamped(body, target, targetP, options, stats);
+
+    stats.error     = glm::length(targetP - forwardChain(body, m_local.data()));
+    stats.converged = stats.error <= options.tolerance;
+    if (stats.evaluations > 0)
+        for (int k = 0; k < n - 1; k++) body.setQ(m_chain[k], m_local[k]);
+    return stats;
 }
 
-void Body::solveIK(int target, const glm::vec3& targetP) {
+void IKSolver::solvePseudoinverse(Body body, int, const glm::vec3& targetP,
+                                  const IKOptions& options, IKStats& stats) {
     using namespace Eigen;
     using namespace glm;
 
-    auto ancestors = getAncestors(target);
-    if (ancestors.empty()) return;
-
     const vec3 axes[] = { {1,0,0}, {0,1,0}, {0,0,1} };
-    const int  dof    = (int)ancestors.size() * 3;
-
-    MatrixXf J(3, dof);
-    MatrixXf b(3, 1);
+    const int  chain  = (int)m_chain.size();
+    const int  dof    = chain * 3;
+    Map<Matrix<float, 3, Dynamic>> J(m_jacobian.data(), 3, dof);
 
     // Iterative Jacobian IK
-    // dTheta = J^+ * dP,  where J^+ is the SVD pseudo-inverse
-    for (int iter = 0; iter < 100; iter++) {
+    // dTheta = J^+ * dP. With J = U S V^T, J^+ = J^T U S^-2 U^T, and U, S^2
+    // are the SVD of the 3x3 J J^T, so the pseudo-inverse needs no dof-sized
+    // decomposition.
+    for (int iter = 0; iter < options.maxIterations; iter++) {
         // Early exit when close enough
-        vec3 err = targetP - links[target].getPos();
-        if (length(err) < 0.01f) break;
+        const vec3 end = forwardChain(body, m_local.data());
+        vec3 err = targetP - end;
+        if (length(err) < options.tolerance) break;
+        stats.iterations++;
+        stats.evaluations++;
 
         // Build Jacobian: J(i,j) = axis_j × (p_end - p_joint_i)
-        for (int i = 0; i < (int)ancestors.size(); i++) {
-            vec3 p = links[target].getPos() - links[ancestors[i]].getPos();
+        Matrix3f JJt = Matrix3f::Zero();
+        for (int i = 0; i < chain; i++) {
+            vec3 p = end - m_worldP[i];
             for (int j = 0; j < 3; j++) {
                 vec3 v = cross(axes[j], p);
                 J.col(i * 3 + j) << v.x, v.y, v.z;
+                JJt.noalias() += J.col(i * 3 + j) * J.col(i * 3 + j).transpose();
             }
         }
 
-        b << err.x, err.y, err.z;
+        // Singular values of J below 1% of the largest are treated as zero
+        // (S^2 below 1e-4 of the largest) to handle near-singular cases
+        JacobiSVD<Matrix3f> svd(JJt, ComputeFullU);
+        const Vector3f& s2 = svd.singularValues();
+        Vector3f w = svd.matrixU().transpose() * Vector3f(err.x, err.y, err.z);
+        for (int k = 0; k < 3; k++)
+            w[k] = s2[k] > 1e-4f * s2[0] ? w[k] / s2[k] : 0.f;
+        w = svd.matrixU() * w;
 
-        // Solve via SVD with threshold to handle near-singular cases
-        auto solver = J.bdcSvd(ComputeThinU | ComputeThinV);
-        solver.setThreshold(0.01f);
-        auto x = solver.solve(b);
+        // Apply incremental rotations (exponential map for smooth quaternion
+        // interp); the root is not rotated
+        for (int i = 0; i < chain - 1; i++) {
+            for (int j = 0; j < 3; j++) {
+                const float x = J.col(i * 3 + j).dot(w);
+                m_local[i] = glm::exp(quat(0.f, 0.01f * axes[j] * x)) * m_local[i];
+            }
+            m_local[i] = glm::normalize(m_local[i]);
+        }
+    }
+}
+
+void IKSolver::solveDamped(Body body, int, const glm::vec3& targetP,
+                           const IKOptions& options, IKStats& stats) {
+    using namespace Eigen;
+    using namespace glm;
+
+    // Damping bounds, relative like options.damping; past the upper one no
+    // step reduces the error and the solve stops where it is
+    constexpr float k_minDamping = 1e-6f;
+    constexpr float k_maxDamping = 1e6f;
 
-        // Apply incremental rotations (exponential map for smooth quaternion interp)
-        for (int i = 0; i < (int)ancestors.size(); i++) {
-            if (links[ancestors[i]].parentIndex < 0) break;
-            for (int j = 0; j < 3; j++)
-                links[ancestors[i]].rotate(glm::exp(quat(0.f, 0.01f * axes[j] * x(i * 3 + j))));
-            links[ancestors[i]].q = glm::normalize(links[ancestors[i]].q);
+    const vec3 axes[] = { {1,0,0}, {0,1,0}, {0,0,1} };
+    const int  chain  = (int)m_chain.size() - 1;   // the root link stays put
+    if (chain == 0) return;
+    Map<Matrix<float, 3, Dynamic>> J(m_jacobian.data(), 3, chain * 3);
+
+    float damping = options.damping;
+    vec3  end     = forwardChain(body, m_local.data());
+    vec3  err     = targetP - end;
+    float error   = length(err);
+    for (int iter = 0; iter < options.maxIterations && error > options.tolerance; iter++) {
+        stats.iterations++;
+
+        // Jacobian of world-axis rotations about each joint:
+        // J(i,j) = axis_j × (p_end - p_joint_i), from the accepted pose,
+        // whose transforms m_worldP / m_worldQ hold
+        Matrix3f JJt = Matrix3f::Zero();
+        for (int i = 0; i < chain; i++) {
+            const vec3 p = end - m_worldP[i];
+            for (int j = 0; j < 3; j++) {
+                const vec3 v = cross(axes[j], p);
+                J.col(i * 3 + j) << v.x, v.y, v.z;
+                JJt.noalias() += J.col(i * 3 + j) * J.col(i * 3 + j).transpose();
+            }
         }
+        const float scale = JJt.trace() / 3.f;
+        if (scale <= 0.f) break;   // every joint sits on the effector
+
+        // Trial steps: retry with more damping until one reduces the error.
+        // A world rotation r about joint i turns its local rotation into
+        // parentW^-1 * r * parentW * local, parentW taken before the step,
+        // so each link turns about its joint's current frame and the links
+        // above it carry it along.
+        for (;;) {
+            const Matrix3f A = JJt + Matrix3f::Identity() * (damping * scale);
+            const Vector3f w = A.ldlt().solve(Vector3f(err.x, err.y, err.z));
+            for (int i = 0; i < chain; i++) {
+                const Vector3f x     = J.middleCols<3>(i * 3).transpose() * w;
+                const vec3     omega(x[0], x[1], x[2]);
+                const float    angle = length(omega);
+                if (angle <= 0.f) {
+                    m_trial[i] = m_local[i];
+                    continue;
+                }
+                m_trial[i] = turnLocal(m_worldQ[i + 1], angleAxis(angle, omega / angle), m_local[i]);
+            }
+            stats.evaluations++;
 
-        // Propagate updated rotations to world positions before next iteration
-        updatePos(0);
+            // Overwrites the chain transforms, restored below if rejected
+            const vec3  trialEnd = forwardChain(body, m_trial.data());
+            const vec3  trialErr = targetP - trialEnd;
+            const float trial    = length(trialErr);
+            if (trial < error) {
+                m_local.swap(m_trial);
+                end     = trialEnd;
+                err     = trialErr;
+                error   = trial;
+                damping = std::max(damping * 0.3f, k_minDamping);
+                break;
+            }
+            stats.rejected++;
+            damping *= 10.f;
+            if (damping > k_maxDamping) return;
+            forwardChain(body, m_local.data());
+        }
     }
 }
 
-void Body::getDisplacement(const Body& origin, const Body& edited) {
-    Eigen::MatrixXf d((int)links.size() + 1, 3);
+bool IKSolver::solveTwoBone(Body body, const glm::vec3& targetP, const IKOptions& options, IKStats& stats) {
+    using namespace glm;
 
-    // Root translation displacement (in local frame of origin root)
-    glm::vec3 t = glm::inverse(origin.links[0].q)
-                  * (edited.links[0].getPos() - origin.links[0].getPos())
-                  * origin.links[0].q;
-    d(0, 0) = t.x;
-    d(0, 1) = t.y;
-    d(0, 2) = t.z;
+    // Chain: 0 = middle joint (knee / elbow), 1 = top (hip / shoulder),
+    // which must not be the root
+    constexpr float k_eps = 1e-6f;
+    const int n = (int)m_chain.size();
+    if (n < 3) return false;
+    std::copy_n(m_local.begin(), n, m_trial.begin());
 
-    // Per-joint orientation displacement via quaternion log-map
-    for (int i = 1; i < (int)links.size() + 1; i++) {
-        glm::quat dq  = glm::log(glm::inverse(origin.links[i - 1].q) * edited.links[i - 1].q);
-        d(i, 0) = dq.x;
-        d(i, 1) = dq.y;
-        d(i, 2) = dq.z;
+    vec3 c = forwardChain(body, m_trial.data());
+    const vec3  a   = m_worldP[1];
+    const vec3  b   = m_worldP[0];
+    const float lab = length(b - a), lcb = length(c - b), lat = length(targetP - a);
+    if (lab < k_eps || lcb < k_eps || lat < k_eps) return false;
+    // Out of the limb's reach: the iterative solver can bring in the joints
+    // above it (spine, clavicle)
+    if (lat > lab + lcb || lat < std::abs(lab - lcb)) return false;
+
+    // 1. Bend the middle joint until the limb spans the distance to the
+    // target, in the current bend plane or, for a straight limb, the pole's
+    vec3 axis = cross(c - b, a - b);
+    if (length(axis) < k_eps * lab * lcb) {
+        if (!options.usePole) return false;
+        axis = cross(c - b, options.pole - b);
+        if (length(axis) < k_eps * lab * lcb) return false;
+    }
+    axis = normalize(axis);
+    const float bend0 = std::acos(clamp(dot(a - b, c - b) / (lab * lcb), -1.f, 1.f));
+    const float bend1 = std::acos(clamp((lab * lab + lcb * lcb - lat * lat) / (2.f * lab * lcb), -1.f, 1.f));
+    m_trial[0] = turnLocal(m_worldQ[1], angleAxis(bend0 - bend1, axis), m_trial[0]);
+    c = forwardChain(body, m_trial.data());
+
+    // 2. Swing the limb about the top joint onto the target
+    m_trial[1] = turnLocal(m_worldQ[2], rotation(normalize(c - a), (targetP - a) / lat), m_trial[1]);
+    stats.evaluations = 2;
+
+    // 3. Twist it about the top-to-target line so the middle joint faces the pole
+    if (options.usePole) {
+        c = forwardChain(body, m_trial.data());
+        const vec3 line = normalize(c - a);
+        vec3 mid  = m_worldP[0] - a;
+        vec3 pole = options.pole - a;
+        mid  -= line * dot(mid, line);
+        pole -= line * dot(pole, line);
+        if (length(mid) > k_eps * lab && length(pole) > k_eps)
+            m_trial[1] = turnLocal(m_worldQ[2], rotation(normalize(mid), normalize(pole)), m_trial[1]);
+        stats.evaluations++;
+    }
+
+    m_local.swap(m_trial);
+    stats.iterations = 1;
+    stats.twoBone    = true;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// IKSolver — multi-effector
+// ---------------------------------------------------------------------------
+
+// Largest share of non-zero 3x3 blocks for which the stacked Jacobian is
+// stored sparse
+static constexpr float k_sparseDensity = 0.5f;
+
+// out = J J^T for the compressed stacked Jacobian. An effector's three rows
+// have the same columns, so each pair of effectors merges its column lists
+// once into a 3x3 block (Eigen's sparse product would build a sparse
+// temporary).
+static void sparseGram(const Eigen::SparseMatrix<float, Eigen::RowMajor>& J, Eigen::MatrixXf& out) {
+    const int    count = (int)J.rows() / 3;
+    const int*   outer = J.outerIndexPtr();
+    const int*   inner = J.innerIndexPtr();
+    const float* value = J.valuePtr();
+    out.resize(3 * count, 3 * count);
+    for (int e = 0; e < count; e++)
+        for (int f = e; f < count; f++) {
+            Eigen::Matrix3f block = Eigen::Matrix3f::Zero();
+            const int aLen = outer[3 * e + 1] - outer[3 * e], bLen = outer[3 * f + 1] - outer[3 * f];
+            for (int a = outer[3 * e], b = outer[3 * f], aEnd = a + aLen, bEnd = b + bLen; a < aEnd && b < bEnd;) {
+                if      (inner[a] < inner[b]) a++;
+                else if (inner[b] < inner[a]) b++;
+                else {
+                    for (int r = 0; r < 3; r++)
+                        for (int c = 0; c < 3; c++) block(r, c) += value[a + r * aLen] * value[b + c * bLen];
+                    a++;
+                    b++;
+                }
+            }
+            out.block<3, 3>(3 * e, 3 * f) = block;
+            out.block<3, 3>(3 * f, 3 * e) = block.transpose();
+        }
+}
+
+float IKSolver::forwardJoints(Body body, const glm::quat* local, const IKEffector* effectors, int count) {
+    // Links are in depth-first order, so a moved joint's parent is either
+    // moved and already done, or the root
+    const Skeleton& sk = body.clip->skeleton();
+    for (int k = 0; k < (int)m_joints.size(); k++) {
+        const int  j    = m_joints[k];
+        const int  slot = m_slot[sk.parent[j]];
+        const glm::vec3& pp = slot < 0 ? m_rootP : m_worldP[slot];
+        const glm::quat& pq = slot < 0 ? m_rootQ : m_worldQ[slot];
+        m_worldP[k] = pp + pq * body.l(j);
+        m_worldQ[k] = pq * local[k];
     }
 
-    displacement = d;
+    float cost = 0.f;
+    for (int e = 0; e < count; e++) {
+        const int j = effectors[e].joint;
+        if (j == 0) {
+            m_endP[e] = m_rootP;
+        }
+        else {
+            const int slot = m_slot[sk.parent[j]];
+            m_endP[e] = slot < 0 ? m_rootP + m_rootQ * body.l(j) : m_worldP[slot] + m_worldQ[slot] * body.l(j);
+        }
+        const glm::vec3 d = effectors[e].target - m_endP[e];
+        cost += glm::dot(d, d);
+    }
+    return cost;
+}
+
+IKStats IKSolver::solve(Body body, const IKEffector* effectors, int count, const IKOptions& options) {
+    using namespace Eigen;
+    using namespace glm;
+
+    if (count == 1) return solve(body, effectors[0].joint, effectors[0].target, options);
+    IKStats stats;
+    if (count <= 0) {
+        stats.converged = true;
+        return stats;
+    }
+
+    constexpr float k_minDamping = 1e-6f;
+    constexpr float k_maxDamping = 1e6f;
+
+    // Moved joints: every ancestor of an effector but the root
+    const Skeleton& sk       = body.clip->skeleton();
+    const int       numLinks = body.numLinks();
+    reserve(numLinks);
+    std::fill_n(m_slot.begin(), numLinks, -1);
+    for (int e = 0; e < count; e++)
+        for (int i = effectors[e].joint > 0 ? sk.parent[effectors[e].joint] : 0; i > 0; i = sk.parent[i])
+            m_slot[i] = 0;
+    m_joints.clear();
+    for (int i = 1; i < numLinks; i++)
+        if (m_slot[i] == 0) {
+            m_slot[i] = (int)m_joints.size();
+            m_joints.push_back(i);
+        }
+
+    const int n = (int)m_joints.size();
+    for (int k = 0; k < n; k++) m_local[k] = body.q(m_joints[k]);
+    m_rootP = body.l(0);
+    m_rootQ = body.q(0);
+    if (m_endP.size() < (size_t)count) m_endP.resize(count);
+
+    // Joint k moves effector e iff e is in k's subtree
+    auto moves = [&](int k, int e) {
+        const int j = m_joints[k], end = effectors[e].joint;
+        return j < end && end < sk.subtreeEnd[j];
+    };
+    const int rows = 3 * count, cols = 3 * n;
+    int blocks = 0;
+    for (int e = 0; e < count; e++)
+        for (int k = 0; k < n; k++) blocks += moves(k, e);
+    stats.sparse = blocks <= k_sparseDensity * count * n;
+
+    // Sparsity pattern, fixed for the solve; iterations only rewrite values.
+    // Building it allocates, so it is kept for the next solve on the same
+    // effectors (a drag, or the frames of a constraint set).
+    const bool samePattern = m_patternSkeleton == &sk && m_pattern.size() == (size_t)count &&
+                             m_sparseJ.rows() == rows && m_sparseJ.cols() == cols &&
+                             std::equal(m_pattern.begin(), m_pattern.end(), effectors,
+                                        [](int j, const IKEffector& e) { return j == e.joint; });
+    if (stats.sparse && !samePattern) {
+        m_rowSize.resize(rows);
+        for (int e = 0; e < count; e++) {
+            int b = 0;
+            for (int k = 0; k < n; k++) b += moves(k, e);
+            m_rowSize.segment<3>(3 * e).setConstant(3 * b);
+        }
+        m_sparseJ.resize(rows, cols);
+        m_sparseJ.reserve(m_rowSize);
+        for (int r = 0; r < rows; r++)
+            for (int k = 0; k < n; k++)
+                if (moves(k, r / 3))
+                    for (int c = 0; c < 3; c++) m_sparseJ.insert(r, 3 * k + c) = 0.f;
+        m_sparseJ.makeCompressed();
+        m_patternSkeleton = &sk;
+        m_pattern.clear();
+        for (int e = 0; e < count; e++) m_pattern.push_back(effectors[e].joint);
+    }
+    if (!stats.sparse && m_jacobian.size() < (size_t)rows * cols) {
+        m_jacobian.resize((size_t)rows * cols);
+    }
+    Map<MatrixXf> denseJ(m_jacobian.data(), stats.sparse ? 0 : rows, stats.sparse ? 0 : cols);
+    denseJ.setZero();   // blocks of joints that do not move an effector stay zero
+    m_err.resize(rows);
+
+    const vec3 axes[] = { {1,0,0}, {0,1,0}, {0,0,1} };
+    auto updateErr = [&]() {
+        float worst = 0.f;
+        for (int e = 0; e < count; e++) {
+            const vec3 d = effectors[e].target - m_endP[e];
+            m_err.segment<3>(3 * e) << d.x, d.y, d.z;
+            worst = std::max(worst, length(d));
+        }
+        return worst;
+    };
+
+    float damping = options.damping;
+    float cost    = forwardJoints(body, m_local.data(), effectors, count);
+    float worst   = updateErr();
+    for (int iter = 0; iter < options.maxIterations && worst > options.tolerance && n > 0; iter++) {
+        stats.iterations++;
+
+        // J(e, k, j) = axis_j × (p_e - p_joint_k)
+        if (stats.sparse) {
+            // An effector's rows hold its joints' column triples in the same order
+            const int* outer = m_sparseJ.outerIndexPtr();
+            const int* inner = m_sparseJ.innerIndexPtr();
+            float*     value = m_sparseJ.valuePtr();
+            for (int e = 0; e < count; e++) {
+                const int begin = outer[3 * e], len = outer[3 * e + 1] - begin;
+                for (int i = 0; i < len; i += 3) {
+                    const vec3 p = m_endP[e] - m_worldP[inner[begin + i] / 3];
+                    for (int j = 0; j < 3; j++) {
+                        const vec3 v = cross(axes[j], p);
+                        for (int r = 0; r < 3; r++) value[begin + r * len + i + j] = v[r];
+                    }
+                }
+            }
+            sparseGram(m_sparseJ, m_normal);
+        }
+        else {
+            for (int e = 0; e < count; e++)
+                for (int k = 0; k < n; k++) {
+                    if (!moves(k, e)) continue;
+                    const vec3 p = m_endP[e] - m_worldP[k];
+                    for (int j = 0; j < 3; j++) {
+                        const vec3 v = cross(axes[j], p);
+                        denseJ.block<3, 1>(3 * e, 3 * k + j) << v.x, v.y, v.z;
+                    }
+                }
+            m_normal.noalias() = denseJ * denseJ.transpose();
+        }
+        const float scale = m_normal.trace() / rows;
+        if (scale <= 0.f) break;
+
+        // Trial steps as in solveDamped, on the summed squared error
+        for (;;) {
+            m_damped = m_normal;
+            m_damped.diagonal().array() += damping * scale;
+            m_w = m_ldlt.compute(m_damped).solve(m_err);
+            if (stats.sparse) m_step.noalias() = m_sparseJ.transpose() * m_w;
+            else              m_step.noalias() = denseJ.transpose() * m_w;
+
+            for (int k = 0; k < n; k++) {
+                const vec3  omega(m_step[3 * k], m_step[3 * k + 1], m_step[3 * k + 2]);
+                const float angle = length(omega);
+                if (angle <= 0.f) {
+                    m_trial[k] = m_local[k];
+                    continue;
+                }
+                const int slot = m_slot[sk.parent[m_joints[k]]];
+                m_trial[k] = turnLocal(slot < 0 ? m_rootQ : m_worldQ[slot], angleAxis(angle, omega / angle), m_local[k]);
+            }
+            stats.evaluations++;
+
+            const float trial = forwardJoints(body, m_trial.data(), effectors, count);
+            if (trial < cost) {
+                m_local.swap(m_trial);
+                cost    = trial;
+                worst   = updateErr();
+                damping = std::max(damping * 0.3f, k_minDamping);
+                break;
+            }
+            stats.rejected++;
+            damping *= 10.f;
+            forwardJoints(body, m_local.data(), effectors, count);
+            if (damping > k_maxDamping) break;
+        }
+        if (damping > k_maxDamping) break;
+    }
+
+    stats.error     = worst;
+    stats.converged = worst <= options.tolerance;
+    if (stats.evaluations > 0)
+        for (int k = 0; k < n; k++) body.setQ(m_joints[k], m_local[k]);
+    return stats;
+}
+
+// ---------------------------------------------------------------------------
+// IKLanes
+// ---------------------------------------------------------------------------
+
+void IKLanes::solve(MotionClip& clip, int target, const int* frames, const glm::vec3* targets, int count,
+                    const IKOptions& options, IKStats* stats, QuatTracks::Isa isa) {
+    constexpr int K = ik::k_lanes;
+    const Skeleton& sk = clip.skeleton();
+    m_chain.clear();
+    for (int i = sk.parent[target]; i >= 0; i = sk.parent[i]) m_chain.push_back(i);
+    const int n = (int)m_chain.size();
+    if (n < 2) {
+        // Nothing to turn (the root or its child)
+        for (int k = 0; stats && k < count; k++) {
+            stats[k] = IKStats();
+            stats[k].error     = glm::length(targets[k] - clip.worldP(target, frames[k]));
+            stats[k].converged = stats[k].error <= options.tolerance;
+        }
+        return;
+    }
+    m_offset.resize(n - 1);
+    for (int k = 0; k < n - 1; k++) m_offset[k] = sk.offset[m_chain[k]];
+
+    // local, trial, worldQ, trialQ: 4 planes per position; worldP, trialP: 3;
+    // target 3 and the four results
+    const size_t quats = (size_t)4 * n * K, points = (size_t)3 * n * K;
+    if (m_planes.size() < 4 * quats + 2 * points + 7 * K) m_planes.resize(4 * quats + 2 * points + 7 * K);
+    ik::LaneGroup g;
+    g.n           = n;
+    g.offset      = m_offset.data();
+    g.endOffset   = sk.offset[target];
+    g.local       = m_planes.data();
+    g.trial       = g.local  + quats;
+    g.worldQ      = g.trial  + quats;
+    g.trialQ      = g.worldQ + quats;
+    g.worldP      = g.trialQ + quats;
+    g.trialP      = g.worldP + points;
+    float* goal   = g.trialP + points;
+    g.target      = goal;
+    g.iterations  = goal + 3 * K;
+    g.evaluations = g.iterations + K;
+    g.rejected    = g.evaluations + K;
+    g.error       = g.rejected + K;
+
+    ik::LaneOptions laneOptions;
+    laneOptions.maxIterations = options.maxIterations;
+    laneOptions.tolerance     = options.tolerance;
+    laneOptions.damping       = options.damping;
+
+    auto setQ = [&](float* planes, int k, int lane, const glm::quat& q) {
+        float* p = planes + (size_t)k * 4 * K + lane;
+        p[0] = q.w; p[K] = q.x; p[2 * K] = q.y; p[3 * K] = q.z;
+    };
+    for (int g0 = 0; g0 < count; g0 += K) {
+        // Lanes past the end repeat the group's first problem
+        const int m = std::min(K, count - g0);
+        for (int lane = 0; lane < K; lane++) {
+            const int       f = frames[g0 + (lane < m ? lane : 0)];
+            const glm::vec3 t = targets[g0 + (lane < m ? lane : 0)];
+            for (int k = 0; k < n - 1; k++) setQ(g.local, k, lane, clip.localQ(m_chain[k], f));
+            setQ(g.worldQ, n - 1, lane, clip.localQ(0, f));
+            const glm::vec3 root = clip.rootPos(f);
+            float* p = g.worldP + (size_t)(n - 1) * 3 * K + lane;
+            p[0] = root.x; p[K] = root.y; p[2 * K] = root.z;
+            goal[lane] = t.x; goal[K + lane] = t.y; goal[2 * K + lane] = t.z;
+        }
+
+        if (isa == QuatTracks::Isa::Avx2)
+            ik::solveLanesAvx2(g, laneOptions);
+#ifdef SIMD_X64
+        else if (isa == QuatTracks::Isa::Sse2)
+            for (int lane = 0; lane < K; lane += simd::Sse4::width) ik::solveLanes<simd::Sse4>(g, lane, laneOptions);
+#endif
+        else
+            for (int lane = 0; lane < K; lane++) ik::solveLanes<simd::Float1>(g, lane, laneOptions);
+
+        for (int lane = 0; lane < m; lane++) {
+            const int f = frames[g0 + lane];
+            if (g.evaluations[lane] > 0.f)
+                for (int k = 0; k < n - 1; k++) {
+                    const float* q = g.local + (size_t)k * 4 * K + lane;
+                    clip.setLocalQ(m_chain[k], f, glm::quat(q[0], q[K], q[2 * K], q[3 * K]));
+                }
+            if (!stats) continue;
+            IKStats& s    = stats[g0 + lane];
+            s             = IKStats();
+            s.iterations  = (int)g.iterations[lane];
+            s.evaluations = (int)g.evaluations[lane];
+            s.rejected    = (int)g.rejected[lane];
+            s.error       = g.error[lane];
+            s.converged   = s.error <= options.tolerance;
+        }
+    }
 }
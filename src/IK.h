@@ -2,8 +2,13 @@
 // IK.h
 // ConstraintBasedMotionEdit
 //
-// Link/Body data structures and inverse kinematics solver.
-// Implements a Jacobian-based IK with SVD pseudo-inverse (Eigen).
+// Body (one-frame pose view) and inverse kinematics solver.
+// Implements a Jacobian-based IK (Eigen): damped least squares with adaptive
+// damping by default, or the original SVD pseudo-inverse, plus a closed-form
+// two-bone solve for hands and feet and a multi-effector solve over a
+// stacked Jacobian. IKSolver keeps its workspaces between solves so a drag
+// does no heap allocation; IKLanes solves one chain on many frames with a
+// SIMD lane per frame.
 //
 
 #pragma once
@@ -12,77 +17,200 @@
 #include <glm/gtx/quaternion.hpp>
 #include <Eigen/Core>
 #include <Eigen/Dense>
+#include <Eigen/SparseCore>
 #include <vector>
 
+#include "MotionClip.h"
 #include "ShaderUtils.h"
 
 // ---------------------------------------------------------------------------
-// Link  — one bone in the kinematic chain
+// IK options and convergence statistics
 // ---------------------------------------------------------------------------
-struct Link {
-    glm::vec3 l  = glm::vec3(0);              // local offset from parent joint
-    glm::quat q  = glm::quat(1, 0, 0, 0);    // local orientation
-
-    glm::vec3 m_parentGlobalP = glm::vec3(0);
-    glm::quat m_parentGlobalQ = glm::quat(1, 0, 0, 0);
-
-    bool isEnd      = false;
-    int  parentIndex = -1;
-    int  childIndex  = -1;
-
-    Link(int parI, int chiI,
-         const glm::vec3& ll, const glm::quat& qq,
-         const glm::vec3& pl, const glm::quat& pq,
-         bool end)
-        : parentIndex(parI), childIndex(chiI),
-          l(ll), q(qq),
-          m_parentGlobalP(pl), m_parentGlobalQ(pq),
-          isEnd(end) {}
-
-    // World position of this joint
-    glm::vec3 getPos() const { return m_parentGlobalQ * l + m_parentGlobalP; }
-    // World orientation of this joint
-    glm::quat getOri() const { return m_parentGlobalQ * q; }
-
-    void rotate(const glm::quat& rot)                   { q = rot * q; }
-    void updatePose(const glm::vec3& pos, const glm::quat& ori) {
-        m_parentGlobalP = pos;
-        m_parentGlobalQ = ori;
-    }
-
-    void render() const;
-    void shapeRender() const;
+struct IKOptions {
+    enum class Method {
+        // Levenberg-Marquardt: dTheta = J^T (J J^T + lambda^2 I)^-1 e through
+        // the 3x3 normal equations. A step that does not reduce the error is
+        // undone and retried with more damping (a shorter, more gradient-like
+        // step); accepted steps relax the damping.
+        DampedLeastSquares,
+        // The original solver: SVD pseudo-inverse, steps scaled by 0.01
+        Pseudoinverse,
+    };
+    Method method        = Method::DampedLeastSquares;
+    int    maxIterations = 100;
+    float  tolerance     = 0.01f;   // distance to the target, world units
+    float  damping       = 0.01f;   // initial lambda^2, relative to the mean diagonal of J J^T
+
+    // Targets that end a limb (Skeleton::limbEnd) are solved in closed form
+    // by turning only the two bones above them. Other targets, targets out of
+    // the limb's reach and straight limbs without a pole use method.
+    bool      twoBone = true;
+    // Two-bone: bend the middle joint (knee / elbow) towards this world
+    // position instead of keeping the limb's current bend plane
+    bool      usePole = false;
+    glm::vec3 pole    = glm::vec3(0);
+};
+
+// Of the last solve
+struct IKStats {
+    int   iterations  = 0;       // Jacobian evaluations
+    int   evaluations = 0;       // FK evaluations of trial steps
+    int   rejected    = 0;       // trial steps undone (DLS)
+    float error       = 0.f;     // final distance to the target (the farthest one, multi-effector)
+    bool  converged   = false;   // error <= tolerance
+    bool  twoBone     = false;   // solved by the two-bone path
+    bool  sparse      = false;   // multi-effector: the stacked Jacobian was stored sparse
+};
+
+// One target of a multi-effector solve
+struct IKEffector {
+    int       joint  = 0;
+    glm::vec3 target = glm::vec3(0);
 };
 
 // ---------------------------------------------------------------------------
-// Body  — full skeleton (collection of Links)
+// Body  — view of one frame of a MotionClip (the full skeleton's pose)
 // ---------------------------------------------------------------------------
 struct Body {
-    std::vector<Link>  links;
-    glm::vec3          globalP      = glm::vec3(0);
-    glm::quat          globalQ      = glm::quat(1, 0, 0, 0);
-    Eigen::MatrixXf    displacement;
-    bool               constraint   = false;
-
-    void clear();
-    void add(int parI, int chiI,
-             const glm::vec3& ll, const glm::quat& qq,
-             const glm::vec3& pl, const glm::quat& pq,
-             bool end);
+    MotionClip* clip  = nullptr;
+    int         frame = 0;
+
+    Body() = default;
+    Body(MotionClip& c, int f) : clip(&c), frame(f) {}
+
+    int  numLinks()         const { return clip->numLinks(); }
+    int  parentIndex(int i) const { return clip->skeleton().parent[i]; }
+    int  childIndex(int i)  const { return clip->skeleton().child[i]; }
+    bool isEnd(int i)       const { return clip->skeleton().isEnd[i] != 0; }
+
+    // Local offset from the parent joint (the root's is its position)
+    glm::vec3 l(int i) const { return i == 0 ? clip->rootPos(frame) : clip->skeleton().offset[i]; }
+    // Local orientation; writes go to the clip (an override on edit layers)
+    glm::quat q(int i) const                    { return clip->localQ(i, frame); }
+    void      setQ(int i, const glm::quat& rot) { clip->setLocalQ(i, frame, rot); }
+
+    // World position / orientation of a joint, from the clip's FK cache
+    glm::vec3 getPos(int i) const { return clip->worldP(i, frame); }
+    glm::quat getOri(int i) const { return clip->worldQ(i, frame); }
+
+    void rotate(int i, const glm::quat& rot) { setQ(i, rot * q(i)); }
+
+    // Frames with a displacement are the constrained ones (see MotionClip)
+    bool constraint() const { return clip->displacements().count(frame) != 0; }
 
     void render()      const;
     void shapeRender() const;
 
-    // Forward kinematics — propagates transforms down the chain.
-    // condition selects which sub-chain to update (0 = all).
-    void updatePos(int condition);
+    // Forward kinematics of the whole body now. Rotating a link marks just
+    // its subtree for recomputation (MotionClip) and reads refresh it, so
+    // this is only needed to force a full pass.
+    void updatePos() { clip->updateWorld(frame, 0, numLinks()); }
 
-    // Returns all ancestor indices from end-effector to root.
-    std::vector<int> getAncestors(int end) const;
+    // Iterative Jacobian IK: move joint 'target' to 'targetP'. Runs on a
+    // per-thread IKSolver.
+    IKStats solveIK(int target, const glm::vec3& targetP, const IKOptions& options = IKOptions());
+    // Moves every effector to its target at once (IKSolver::solve)
+    IKStats solveIK(const std::vector<IKEffector>& effectors, const IKOptions& options = IKOptions());
 
-    // Iterative Jacobian IK: move joint 'target' to 'targetP'.
-    void solveIK(int target, const glm::vec3& targetP);
+    // Stores the quaternion log-map displacement of this pose from the
+    // clip's base pose, which marks the frame constrained.
+    void getDisplacement();
+};
 
-    // Stores the quaternion log-map displacement between origin and edited pose.
-    void getDisplacement(const Body& origin, const Body& edited);
+// ---------------------------------------------------------------------------
+// IKSolver — Jacobian IK over the ancestors of one joint
+// ---------------------------------------------------------------------------
+// The chain and Jacobian live in buffers that only grow, and everything else
+// is fixed-size, so once the buffers have held the longest chain (reserve, or
+// the first solve on it) solving does no heap allocation. The multi-effector
+// solve also keeps dynamic Eigen workspaces and a sparsity pattern, sized by
+// the first solve on an effector set; solves on the same set reuse them.
+// MotionBatch check-ik-alloc and bench-ik check both (Eigen's allocations
+// through EIGEN_RUNTIME_NO_MALLOC) to keep it that way.
+//
+// Iterations run FK over the chain alone: the solver keeps the chain's
+// rotations and world transforms (each link's the prefix product from the
+// root down) and writes the rotations back to the clip once at the end, so
+// an iteration costs the chain length whatever hangs below it. The clip
+// recomputes the moved subtrees when they are next read.
+class IKSolver {
+public:
+    // Sizes the workspaces for any chain of a skeleton with numLinks links.
+    void reserve(int numLinks);
+
+    // Moves joint 'target' of body to 'targetP' by rotating its ancestors
+    // (all but the root link).
+    IKStats solve(Body body, int target, const glm::vec3& targetP, const IKOptions& options = IKOptions());
+
+    // Moves several joints to their targets together: damped least squares
+    // over the union of their chains, with the effectors' Jacobians stacked
+    // (three rows each) and the normal equations 3 * count square. Block
+    // (e, k) of the stack is zero unless joint k is above effector e, so when
+    // the chains share few joints (feet and hands meet only at the root and
+    // spine) it is stored as an Eigen sparse matrix. Uses method only for a
+    // single effector, which takes the path above.
+    IKStats solve(Body body, const IKEffector* effectors, int count, const IKOptions& options = IKOptions());
+
+private:
+    // Chain position k: link m_chain[k]; the last one is the root
+    std::vector<int>       m_chain;      // ancestors, the target's parent first
+    std::vector<float>     m_jacobian;   // 3 x dof, column-major
+    std::vector<glm::quat> m_local;      // chain rotations
+    std::vector<glm::quat> m_trial;      // DLS: chain rotations of the trial step
+    std::vector<glm::vec3> m_worldP;     // chain world transforms, from forwardChain
+    std::vector<glm::quat> m_worldQ;
+    glm::vec3              m_offset;     // target's offset from m_chain[0]
+
+    // Multi-effector: position k is link m_joints[k] (the union of the
+    // chains, in link order), with the same rotation and transform buffers
+    std::vector<int>       m_joints;
+    std::vector<int>       m_slot;       // link -> position, -1 if it does not move
+    std::vector<glm::vec3> m_endP;       // effector positions
+    glm::vec3              m_rootP;
+    glm::quat              m_rootQ;
+    Eigen::SparseMatrix<float, Eigen::RowMajor> m_sparseJ;
+    const Skeleton*        m_patternSkeleton = nullptr;   // m_sparseJ's pattern is for these
+    std::vector<int>       m_pattern;                     // effector joints
+    Eigen::VectorXi        m_rowSize;
+    Eigen::MatrixXf        m_normal, m_damped;   // J J^T, and + lambda^2 I
+    Eigen::VectorXf        m_err, m_w, m_step;
+    Eigen::LDLT<Eigen::MatrixXf> m_ldlt;
+
+    // World transforms of the chain below the root for rotations local, and
+    // the target's position
+    glm::vec3 forwardChain(Body body, const glm::quat* local);
+    // Multi-effector: transforms of m_joints and the effector positions
+    // (m_endP) for rotations local; returns the summed squared error
+    float forwardJoints(Body body, const glm::quat* local, const IKEffector* effectors, int count);
+
+    // False, leaving the pose alone, if the limb cannot reach the target or
+    // is degenerate
+    bool solveTwoBone(Body body, const glm::vec3& targetP, const IKOptions& options, IKStats& stats);
+    void solvePseudoinverse(Body body, int target, const glm::vec3& targetP, const IKOptions& options, IKStats& stats);
+    void solveDamped(Body body, int target, const glm::vec3& targetP, const IKOptions& options, IKStats& stats);
+};
+
+// ---------------------------------------------------------------------------
+// IKLanes — one joint's IK on many frames, a SIMD lane per frame
+// ---------------------------------------------------------------------------
+// The same target joint has the same chain on every frame, so frames are
+// packed ik::k_lanes (8) to a group, laid out side by side (IKKernels.h), and
+// the damped least-squares solve runs for the whole group per instruction
+// (AVX2: one vector, SSE2: two, scalar: one lane at a time). Each lane stops
+// on its own; the group runs until its last one has. Results match
+// solveIK with the default method to rounding. Options other than
+// maxIterations, tolerance and damping are not used (no two-bone path).
+// Like IKSolver, the workspaces only grow.
+class IKLanes {
+public:
+    // Moves joint 'target' to targets[k] on frames[k] of clip, k < count;
+    // frames must be distinct. stats, if given, receives each frame's.
+    void solve(MotionClip& clip, int target, const int* frames, const glm::vec3* targets, int count,
+               const IKOptions& options = IKOptions(), IKStats* stats = nullptr,
+               QuatTracks::Isa isa = QuatTracks::bestIsa());
+
+private:
+    std::vector<int>       m_chain;    // as IKSolver's: the target's parent first, the root last
+    std::vector<glm::vec3> m_offset;   // [k]: chain link k's offset
+    std::vector<float>     m_planes;   // one group's planes (ik::LaneGroup)
 };
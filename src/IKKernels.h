@@ -0,0 +1,256 @@
+//
+// IKKernels.h
+// ConstraintBasedMotionEdit
+//
+// Damped least-squares IK on several independent problems at once, one per
+// SIMD lane. The problems share a chain (the same target joint of one
+// skeleton, on different frames), so every lane runs the same instructions:
+// chain FK, the 3x3 normal equations J J^T + lambda^2 I, their solve and the
+// rotation updates. The algorithm is IKSolver::solveDamped's; its per-lane
+// control flow (accept or reject a trial step, stop at the tolerance, the
+// iteration or the damping limit) becomes masks, and a group runs until its
+// last lane stops. IKLanes (IK.h) packs frames into groups and dispatches.
+//
+// Same operation order as glm for quat * quat and quat * vec3 (like
+// FKKernels.h); sin / cos come from SimdMath, so lanes agree with the scalar
+// solver to rounding, not bit for bit.
+//
+
+#pragma once
+
+#include "SimdMath.h"
+
+#include <glm/glm.hpp>
+
+namespace ik {
+
+// Problems per group. Planes hold one float per lane: component c of chain
+// position k is at [(k * components + c) * k_lanes + lane].
+constexpr int k_lanes = 8;
+
+// Chain positions as in IKSolver: 0 is the target's parent, n - 1 the root,
+// which does not turn.
+struct LaneGroup {
+    int              n = 0;
+    const glm::vec3* offset    = nullptr;        // [k]: position k's offset from k + 1, k < n - 1
+    glm::vec3        endOffset = glm::vec3(0);   // the target's offset from position 0
+
+    float*       local  = nullptr;   // rotations (w, x, y, z), k < n - 1: in / out
+    float*       worldP = nullptr;   // 3 planes per position; the root's is input
+    float*       worldQ = nullptr;   // 4 planes per position; the root's is input
+    float*       trial  = nullptr;   // workspaces shaped like local / worldP / worldQ
+    float*       trialP = nullptr;
+    float*       trialQ = nullptr;
+    const float* target = nullptr;   // 3 planes
+
+    // Per lane, out
+    float* iterations  = nullptr;
+    float* evaluations = nullptr;
+    float* rejected    = nullptr;
+    float* error       = nullptr;
+};
+
+struct LaneOptions {
+    int   maxIterations = 100;
+    float tolerance     = 0.01f;
+    float damping       = 0.01f;
+};
+
+template <class V> struct Vec3L { V x, y, z; };
+template <class V> struct QuatL { V w, x, y, z; };
+
+template <class V>
+inline Vec3L<V> loadP(const float* p, int k, int lane) {
+    p += (size_t)k * 3 * k_lanes + lane;
+    return { V::load(p), V::load(p + k_lanes), V::load(p + 2 * k_lanes) };
+}
+template <class V>
+inline void storeP(float* p, int k, int lane, const Vec3L<V>& v) {
+    p += (size_t)k * 3 * k_lanes + lane;
+    v.x.store(p);
+    v.y.store(p + k_lanes);
+    v.z.store(p + 2 * k_lanes);
+}
+template <class V>
+inline QuatL<V> loadQ(const float* q, int k, int lane) {
+    q += (size_t)k * 4 * k_lanes + lane;
+    return { V::load(q), V::load(q + k_lanes), V::load(q + 2 * k_lanes), V::load(q + 3 * k_lanes) };
+}
+template <class V>
+inline void storeQ(float* q, int k, int lane, const QuatL<V>& v) {
+    q += (size_t)k * 4 * k_lanes + lane;
+    v.w.store(q);
+    v.x.store(q + k_lanes);
+    v.y.store(q + 2 * k_lanes);
+    v.z.store(q + 3 * k_lanes);
+}
+
+template <class V>
+inline Vec3L<V> select(V mask, const Vec3L<V>& a, const Vec3L<V>& b) {
+    return { select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z) };
+}
+template <class V>
+inline QuatL<V> select(V mask, const QuatL<V>& a, const QuatL<V>& b) {
+    return { select(mask, a.w, b.w), select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z) };
+}
+
+template <class V>
+inline Vec3L<V> cross(const Vec3L<V>& a, const Vec3L<V>& b) {
+    return { a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x, a.x * b.y - b.x * a.y };
+}
+template <class V>
+inline V length(const Vec3L<V>& a) { return sqrt(a.x * a.x + a.y * a.y + a.z * a.z); }
+
+template <class V>
+inline QuatL<V> mul(const QuatL<V>& p, const QuatL<V>& q) {
+    return { p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z,
+             p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+             p.w * q.y + p.y * q.w + p.z * q.x - p.x * q.z,
+             p.w * q.z + p.z * q.w + p.x * q.y - p.y * q.x };
+}
+// q * v for a constant v
+template <class V>
+inline Vec3L<V> rotate(const QuatL<V>& q, const glm::vec3& v) {
+    const V ox(v.x), oy(v.y), oz(v.z), two(2.f);
+    const Vec3L<V> u   = { q.x, q.y, q.z };
+    const Vec3L<V> uv  = { q.y * oz - oy * q.z, q.z * ox - oz * q.x, q.x * oy - ox * q.y };
+    const Vec3L<V> uuv = cross(u, uv);
+    return { ox + ((uv.x * q.w) + uuv.x) * two,
+             oy + ((uv.y * q.w) + uuv.y) * two,
+             oz + ((uv.z * q.w) + uuv.z) * two };
+}
+
+// Chain FK for rotations local into P / Q (whose root position must be
+// set); returns the target's position
+template <class V>
+inline Vec3L<V> forwardLanes(const LaneGroup& g, const float* local, float* P, float* Q, int lane) {
+    for (int k = g.n - 2; k >= 0; k--) {
+        const Vec3L<V> pp = loadP<V>(P, k + 1, lane);
+        const QuatL<V> pq = loadQ<V>(Q, k + 1, lane);
+        const Vec3L<V> o  = rotate(pq, g.offset[k]);
+        storeP(P, k, lane, Vec3L<V>{ pp.x + o.x, pp.y + o.y, pp.z + o.z });
+        storeQ(Q, k, lane, mul(pq, loadQ<V>(local, k, lane)));
+    }
+    const Vec3L<V> p0 = loadP<V>(P, 0, lane);
+    const Vec3L<V> o  = rotate(loadQ<V>(Q, 0, lane), g.endOffset);
+    return { p0.x + o.x, p0.y + o.y, p0.z + o.z };
+}
+
+// Solves lanes [lane, lane + V::width) of group g
+template <class V>
+void solveLanes(const LaneGroup& g, int lane, const LaneOptions& options) {
+    // Damping bounds as in IKSolver::solveDamped
+    const V minDamping(1e-6f), maxDamping(1e6f);
+    const V zero(0.f), one(1.f), half(0.5f), third(1.f / 3.f);
+    const V all = lessThan(zero, one);
+    const int links = g.n - 1;
+
+    // The trial FK reads the root from the trial planes too
+    storeP(g.trialP, links, lane, loadP<V>(g.worldP, links, lane));
+    storeQ(g.trialQ, links, lane, loadQ<V>(g.worldQ, links, lane));
+
+    const Vec3L<V> target = loadP<V>(g.target, 0, lane);
+    Vec3L<V> end   = forwardLanes<V>(g, g.local, g.worldP, g.worldQ, lane);
+    Vec3L<V> err   = { target.x - end.x, target.y - end.y, target.z - end.z };
+    V        error = length(err);
+
+    V damping(options.damping), iterations = zero, evaluations = zero, rejected = zero;
+    V done  = links > 0 ? zero : all;
+    V retry = zero;   // lanes whose last trial was rejected: same Jacobian, more damping
+    for (;;) {
+        // Lanes starting an iteration stop at the tolerance or the limit
+        V start = andNot(andNot(all, done), retry);
+        V stop  = andNot(start, lessThan(iterations, V((float)options.maxIterations)) & lessThan(V(options.tolerance), error));
+        start   = andNot(start, stop);
+        done    = done | stop;
+        iterations = select(start, iterations + one, iterations);
+
+        // J J^T = sum over joints of |p|^2 I - p p^T, p = end - joint (the
+        // Jacobian's three columns per joint are axis_j x p)
+        V a00 = zero, a01 = zero, a02 = zero, a11 = zero, a12 = zero, a22 = zero;
+        for (int k = 0; k < links; k++) {
+            const Vec3L<V> jp = loadP<V>(g.worldP, k, lane);
+            const V px = end.x - jp.x, py = end.y - jp.y, pz = end.z - jp.z;
+            const V pp = px * px + py * py + pz * pz;
+            a00 = a00 + (pp - px * px);
+            a11 = a11 + (pp - py * py);
+            a22 = a22 + (pp - pz * pz);
+            a01 = a01 - px * py;
+            a02 = a02 - px * pz;
+            a12 = a12 - py * pz;
+        }
+        const V scale = (a00 + a11 + a22) * third;
+        done = done | andNot(start, lessThan(zero, scale));   // every joint sits on the effector
+        const V active = andNot(all, done);
+        if (!anyTrue(active)) break;
+
+        // w = (J J^T + lambda^2 I)^-1 err through the adjugate (symmetric
+        // positive definite once damped)
+        const V lambda = damping * scale;
+        a00 = a00 + lambda;
+        a11 = a11 + lambda;
+        a22 = a22 + lambda;
+        const V c00 = a11 * a22 - a12 * a12, c01 = a02 * a12 - a01 * a22, c02 = a01 * a12 - a02 * a11;
+        const V c11 = a00 * a22 - a02 * a02, c12 = a01 * a02 - a00 * a12, c22 = a00 * a11 - a01 * a01;
+        const V inv = one / (a00 * c00 + a01 * c01 + a02 * c02);
+        const Vec3L<V> w = { (c00 * err.x + c01 * err.y + c02 * err.z) * inv,
+                             (c01 * err.x + c11 * err.y + c12 * err.z) * inv,
+                             (c02 * err.x + c12 * err.y + c22 * err.z) * inv };
+
+        // Joint k turns by omega = J_k^T w = p x w about the world axes:
+        // local' = normalize(parentW^-1 * r * parentW * local)
+        for (int k = 0; k < links; k++) {
+            const Vec3L<V> jp    = loadP<V>(g.worldP, k, lane);
+            const Vec3L<V> omega = cross(Vec3L<V>{ end.x - jp.x, end.y - jp.y, end.z - jp.z }, w);
+            const V        angle = length(omega);
+            V s, c;
+            sincos(angle * half, s, c);
+            const V        axis = s / angle;
+            const QuatL<V> r    = { c, omega.x * axis, omega.y * axis, omega.z * axis };
+
+            const QuatL<V> pw  = loadQ<V>(g.worldQ, k + 1, lane);
+            const QuatL<V> ipw = { pw.w, zero - pw.x, zero - pw.y, zero - pw.z };
+            const QuatL<V> q   = loadQ<V>(g.local, k, lane);
+            QuatL<V>       t   = mul(mul(mul(ipw, r), pw), q);
+            const V        len = one / sqrt(t.w * t.w + t.x * t.x + t.y * t.y + t.z * t.z);
+            t = { t.w * len, t.x * len, t.y * len, t.z * len };
+            storeQ(g.trial, k, lane, select(lessThan(zero, angle), t, q));
+        }
+        evaluations = select(active, evaluations + one, evaluations);
+
+        const Vec3L<V> trialEnd   = forwardLanes<V>(g, g.trial, g.trialP, g.trialQ, lane);
+        const Vec3L<V> trialErr   = { target.x - trialEnd.x, target.y - trialEnd.y, target.z - trialEnd.z };
+        const V        trialError = length(trialErr);
+
+        // Accepted lanes take the trial pose and relax the damping; rejected
+        // ones retry with ten times the damping, or stop past its limit
+        const V accept = active & lessThan(trialError, error);
+        const V reject = andNot(active, accept);
+        for (int k = 0; k < links; k++) {
+            storeQ(g.local,  k, lane, select(accept, loadQ<V>(g.trial,  k, lane), loadQ<V>(g.local,  k, lane)));
+            storeP(g.worldP, k, lane, select(accept, loadP<V>(g.trialP, k, lane), loadP<V>(g.worldP, k, lane)));
+            storeQ(g.worldQ, k, lane, select(accept, loadQ<V>(g.trialQ, k, lane), loadQ<V>(g.worldQ, k, lane)));
+        }
+        end     = select(accept, trialEnd, end);
+        err     = select(accept, trialErr, err);
+        error   = select(accept, trialError, error);
+        damping = select(accept, max(damping * V(0.3f), minDamping), select(reject, damping * V(10.f), damping));
+        rejected = select(reject, rejected + one, rejected);
+
+        stop  = reject & lessThan(maxDamping, damping);
+        done  = done | stop;
+        retry = andNot(reject, stop);
+    }
+
+    iterations.store(g.iterations + lane);
+    evaluations.store(g.evaluations + lane);
+    rejected.store(g.rejected + lane);
+    error.store(g.error + lane);
+}
+
+// AVX2 instantiation over all k_lanes lanes (IKKernelsAvx2.cpp, built with
+// AVX2 code generation like FKKernelsAvx2.cpp); runs the SSE2 kernel when
+// the build has none. Callers check QuatTracks::bestIsa() first.
+void solveLanesAvx2(const LaneGroup& g, const LaneOptions& options);
+
+} // namespace ik
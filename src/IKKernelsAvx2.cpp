@@ -0,0 +1,21 @@
+//
+// IKKernelsAvx2.cpp
+// ConstraintBasedMotionEdit
+//
+// AVX2 instantiation of the lane-parallel IK kernel. This file alone is
+// built with /arch:AVX2 (see the vcxproj), like FKKernelsAvx2.cpp; IKLanes
+// only picks it when QuatTracks::bestIsa() reports AVX2.
+//
+
+#include "IKKernels.h"
+
+void ik::solveLanesAvx2(const LaneGroup& g, const LaneOptions& options) {
+#if defined(SIMD_X64) && defined(__AVX2__)
+    static_assert(k_lanes == simd::Avx8::width, "one AVX2 vector per group");
+    solveLanes<simd::Avx8>(g, 0, options);
+#elif defined(SIMD_X64)
+    for (int lane = 0; lane < k_lanes; lane += simd::Sse4::width) solveLanes<simd::Sse4>(g, lane, options);
+#else
+    for (int lane = 0; lane < k_lanes; lane++) solveLanes<simd::Float1>(g, lane, options);
+#endif
+}
@@ -0,0 +1,107 @@
+//
+// MappedFile.cpp
+// ConstraintBasedMotionEdit
+//
+// Platform-specific file mapping.
+//
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <string>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* path) {
+    close();
+
+    // Paths arrive as UTF-8 (drag-and-drop, command line)
+    int len = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+    std::wstring wpath(len, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath.data(), len);
+
+    HANDLE file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_file    = file;
+    m_mapping = mapping;
+    m_data    = static_cast<const char*>(view);
+    m_size    = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data)    UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle((HANDLE)m_mapping);
+    if (m_file)    CloseHandle((HANDLE)m_file);
+    m_data    = nullptr;
+    m_size    = 0;
+    m_mapping = nullptr;
+    m_file    = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char* path) {
+    close();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    m_fd   = fd;
+    m_data = static_cast<const char*>(view);
+    m_size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data)    munmap(const_cast<char*>(m_data), m_size);
+    if (m_fd >= 0) ::close(m_fd);
+    m_data = nullptr;
+    m_size = 0;
+    m_fd   = -1;
+}
+
+#endif
@@ -0,0 +1,40 @@
+//
+// MappedFile.h
+// ConstraintBasedMotionEdit
+//
+// Read-only memory-mapped file (Win32 file mapping / POSIX mmap).
+//
+
+#pragma once
+
+#include <cstddef>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const char* path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Maps the whole file read-only. Returns false (and stays closed) on
+    // failure or when the file is empty.
+    bool open(const char* path);
+    void close();
+
+    bool        isOpen() const { return m_data != nullptr; }
+    const char* data()   const { return m_data; }
+    const char* end()    const { return m_data + m_size; }
+    size_t      size()   const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+#ifdef _WIN32
+    void*       m_file    = nullptr;
+    void*       m_mapping = nullptr;
+#else
+    int         m_fd      = -1;
+#endif
+};
@@ -0,0 +1,338 @@
+//
+// MotionClip.cpp
+// ConstraintBasedMotionEdit
+//
+// Clip pose storage and lazily updated forward kinematics over its planes.
+//
+
+#include "MotionClip.h"
+#include "FKKernels.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+
+void MotionClip::create(std::shared_ptr<const Skeleton> skeleton, int numFrames) {
+    clear();
+    m_skeleton  = std::move(skeleton);
+    m_numFrames = numFrames;
+    m_numLinks  = m_skeleton ? m_skeleton->size() : 0;
+    m_plane     = (size_t)m_numLinks * numFrames;
+
+    // World planes are left to the first FK pass: a base clip that is only
+    // read for its local pose never needs them
+    m_arena.reserve(Arena::alignedSize(numFrames * sizeof(glm::vec3)) +
+                    Arena::alignedSize(4 * m_plane * sizeof(float)) +
+                    Arena::alignedSize(numFrames * sizeof(Span)));
+    m_rootPos = m_arena.allocate<glm::vec3>(numFrames);
+    m_localQ  = m_arena.allocate<float>(4 * m_plane);
+    m_dirty   = m_arena.allocate<Span>(numFrames);
+    std::uninitialized_fill_n(m_rootPos, numFrames, glm::vec3(0));
+    std::fill_n(m_localQ, m_plane, 1.f);   // identity
+    std::fill_n(m_localQ + m_plane, 3 * m_plane, 0.f);
+    std::uninitialized_fill_n(m_dirty, numFrames, Span());
+    invalidateFrames(0, numFrames);
+}
+
+void MotionClip::createLayer(std::shared_ptr<const MotionClip> base) {
+    clear();
+    m_base      = std::move(base);
+    m_skeleton  = m_base->m_skeleton;
+    m_numFrames = m_base->m_numFrames;
+    m_numLinks  = m_base->m_numLinks;
+    m_plane     = m_base->m_plane;
+
+    // A layer is displayed, so its world planes come with it
+    m_arena.reserve(Arena::alignedSize(m_numFrames * sizeof(int)) +
+                    Arena::alignedSize(m_numFrames * sizeof(Span)) +
+                    Arena::alignedSize(7 * m_plane * sizeof(float)));
+    m_overrideSlot = m_arena.allocate<int>(m_numFrames);
+    m_dirty        = m_arena.allocate<Span>(m_numFrames);
+    std::fill_n(m_overrideSlot, m_numFrames, -1);
+    std::uninitialized_fill_n(m_dirty, m_numFrames, Span());
+    allocateWorld();
+    invalidateFrames(0, m_numFrames);
+}
+
+void MotionClip::clear() {
+    m_skeleton.reset();
+    m_base.reset();
+    m_numFrames = 0;
+    m_numLinks  = 0;
+    m_plane     = 0;
+    m_rootPos      = nullptr;
+    m_localQ       = nullptr;
+    m_overrideSlot = nullptr;
+    m_world        = nullptr;
+    m_dirty        = nullptr;
+    m_arena.release();
+    m_track = DisplacementTrack();
+    std::vector<glm::quat>().swap(m_overrideQ);
+    m_dirtyLo = m_dirtyHi = 0;
+    m_displacement.clear();
+}
+
+void MotionClip::resetLayer() {
+    if (!m_base) return;
+    for (int f = 0; f < m_numFrames; f++)
+        if (m_overrideSlot[f] >= 0) invalidate(f, 0, m_numLinks);
+    invalidateFrames(m_track.firstFrame(), m_track.endFrame());
+
+    m_track = DisplacementTrack();
+    std::fill_n(m_overrideSlot, m_numFrames, -1);
+    std::vector<glm::quat>().swap(m_overrideQ);
+    m_displacement.clear();
+}
+
+void MotionClip::setLocalQ(int link, int f, const glm::quat& q) {
+    invalidate(f, link, m_skeleton->subtreeEnd[link]);
+    if (!m_base) {
+        const size_t i = index(link, f);
+        m_localQ[i]                = q.w;
+        m_localQ[m_plane + i]      = q.x;
+        m_localQ[2 * m_plane + i]  = q.y;
+        m_localQ[3 * m_plane + i]  = q.z;
+        return;
+    }
+    if (m_overrideSlot[f] < 0) {
+        const size_t first = m_overrideQ.size();
+        m_overrideQ.resize(first + m_numLinks);
+        for (int i = 0; i < m_numLinks; i++)
+            m_overrideQ[first + i] = localQ(i, f);
+        m_overrideSlot[f] = (int)(first / m_numLinks);
+    }
+    m_overrideQ[(size_t)m_overrideSlot[f] * m_numLinks + link] = q;
+}
+
+void MotionClip::setOverrideRow(int f, const glm::quat* row) {
+    if (!m_base) return;
+    invalidate(f, 0, m_numLinks);
+    int slot = m_overrideSlot[f];
+    if (row) {
+        if (slot < 0) {
+            slot = numOverrides();
+            m_overrideQ.resize(m_overrideQ.size() + m_numLinks);
+            m_overrideSlot[f] = slot;
+        }
+        std::copy_n(row, m_numLinks, m_overrideQ.begin() + (size_t)slot * m_numLinks);
+        return;
+    }
+    if (slot < 0) return;
+
+    const int last = numOverrides() - 1;
+    if (slot != last) {
+        const int* moved = std::find(m_overrideSlot, m_overrideSlot + m_numFrames, last);
+        std::copy_n(m_overrideQ.begin() + (size_t)last * m_numLinks, m_numLinks,
+                    m_overrideQ.begin() + (size_t)slot * m_numLinks);
+        m_overrideSlot[moved - m_overrideSlot] = slot;
+    }
+    m_overrideQ.resize((size_t)last * m_numLinks);
+    m_overrideSlot[f] = -1;
+}
+
+void MotionClip::setDisplacementTrack(DisplacementTrack track, bool dropCovered) {
+    if (!m_base) return;
+    // Frames either track touches change; overrides the new track drops are
+    // inside its range
+    invalidateFrames(m_track.firstFrame(), m_track.endFrame());
+    invalidateFrames(track.firstFrame(), track.endFrame());
+    m_track = std::move(track);
+    if (!dropCovered) return;
+
+    // Compact the overrides that survive
+    std::vector<glm::quat> kept;
+    for (int f = 0; f < m_numFrames; f++) {
+        const int slot = m_overrideSlot[f];
+        if (slot < 0) continue;
+        if (m_track.covers(f)) {
+            m_overrideSlot[f] = -1;
+            continue;
+        }
+        m_overrideSlot[f] = (int)(kept.size() / m_numLinks);
+        kept.insert(kept.end(), m_overrideQ.begin() + (size_t)slot * m_numLinks,
+                                m_overrideQ.begin() + (size_t)(slot + 1) * m_numLinks);
+    }
+    m_overrideQ.swap(kept);
+}
+
+void MotionClip::allocateWorld() const {
+    if (m_world || m_numLinks == 0) return;
+    m_world = m_arena.allocate<float>(7 * m_plane);
+    std::fill_n(m_world, 7 * m_plane, 0.f);
+}
+
+// ---------------------------------------------------------------------------
+// Dirty tracking
+// ---------------------------------------------------------------------------
+
+void MotionClip::invalidate(int f, int first, int last) {
+    first = std::max(first, 0);
+    last  = std::min(last, m_numLinks);
+    if (first >= last) return;
+
+    Span& d = m_dirty[f];
+    if (d.begin < d.end) {
+        d.begin = std::min(d.begin, first);
+        d.end   = std::max(d.end, last);
+    } else {
+        d.begin = first;
+        d.end   = last;
+    }
+    if (m_dirtyLo < m_dirtyHi) {
+        m_dirtyLo = std::min(m_dirtyLo, f);
+        m_dirtyHi = std::max(m_dirtyHi, f + 1);
+    } else {
+        m_dirtyLo = f;
+        m_dirtyHi = f + 1;
+    }
+}
+
+void MotionClip::invalidateFrames(int f0, int f1) {
+    f0 = std::max(f0, 0);
+    f1 = std::min(f1, m_numFrames);
+    for (int f = f0; f < f1; f++) invalidate(f, 0, m_numLinks);
+}
+
+// ---------------------------------------------------------------------------
+// Forward kinematics
+// ---------------------------------------------------------------------------
+
+// Frames [0, n) of one link through the isa kernel (FKKernelsAvx2.cpp
+// holds the AVX2 instantiation)
+static void forwardFrames(const fk::ConstPlanes& parent, const float* const local[4], const glm::vec3& offset,
+                          const fk::Planes& world, int n, QuatTracks::Isa isa) {
+    if (isa == QuatTracks::Isa::Avx2) {
+        fk::forwardFramesAvx2(parent, local, offset, world, n);
+        return;
+    }
+#ifdef SIMD_X64
+    if (isa == QuatTracks::Isa::Sse2) {
+        fk::forwardFrames<simd::Sse4, simd::Float1>(parent, local, offset, world, n);
+        return;
+    }
+#endif
+    fk::forwardFrames<simd::Float1, simd::Float1>(parent, local, offset, world, n);
+}
+
+void MotionClip::updateRoot(int f) const {
+    const glm::vec3 p = rootPos(f);
+    const glm::quat q = localQ(0, f);
+    const fk::Planes w = fk::worldPlanes(m_world, m_plane, index(0, f));
+    *w.p[0] = p.x;
+    *w.p[1] = p.y;
+    *w.p[2] = p.z;
+    *w.q[0] = q.w;
+    *w.q[1] = q.x;
+    *w.q[2] = q.y;
+    *w.q[3] = q.z;
+}
+
+// Links outside a frame's dirty span are clean, and so are their ancestors
+// (a dirty link dirties its whole subtree), so parents are always current.
+void MotionClip::updateFrame(int f) const {
+    allocateWorld();
+    Span& d = m_dirty[f];
+    int i = d.begin;
+    if (i == 0) {
+        updateRoot(f);
+        i = 1;
+    }
+
+    const Skeleton& sk = *m_skeleton;
+    float*          w  = m_world;
+    for (; i < d.end; i++) {
+        const glm::quat q        = localQ(i, f);
+        const float     local[4] = { q.w, q.x, q.y, q.z };
+        const float*    planes[4] = { &local[0], &local[1], &local[2], &local[3] };
+        fk::forwardFrames<simd::Float1, simd::Float1>(fk::worldPlanes((const float*)w, m_plane, index(sk.parent[i], f)),
+                                                     planes, sk.offset[i], fk::worldPlanes(w, m_plane, index(i, f)), 1);
+    }
+    d = Span();
+}
+
+void MotionClip::updateWorld(int f, int first, int last) {
+    if (m_numLinks == 0) return;
+    invalidate(f, first, last);
+    updateFrame(f);
+}
+
+void MotionClip::updateFrames(int f0, int f1, QuatTracks::Isa isa) const {
+    int first = m_numLinks, last = 0, numDirty = 0;
+    for (int f = f0; f < f1; f++) {
+        const Span& d = m_dirty[f];
+        if (d.begin >= d.end) continue;
+        first = std::min(first, d.begin);
+        last  = std::max(last, d.end);
+        numDirty++;
+    }
+    if (numDirty == 0) return;
+
+    // A few scattered edits (IK drags) are cheaper one frame at a time
+    if (numDirty * 4 < f1 - f0) {
+        for (int f = f0; f < f1; f++) resolve(f);
+        return;
+    }
+
+    // Otherwise links [first, last) of the whole block, clean frames included
+    // (recomputing them gives the values they already hold)
+    const int n = f1 - f0;
+    int i = first;
+    if (i == 0) {
+        for (int f = f0; f < f1; f++) updateRoot(f);
+        i = 1;
+    }
+
+    // Local rotations are read from the planes directly where nothing
+    // overrides the base; edited frames are resolved into scratch planes
+    bool edited = false;
+    if (m_base) {
+        edited = f0 < m_track.endFrame() && f1 > m_track.firstFrame();
+        for (int f = f0; f < f1 && !edited; f++) edited = m_overrideSlot[f] >= 0;
+    }
+    const float* base = m_base ? m_base->m_localQ : m_localQ;
+    float        scratch[4][k_fkBlockFrames];
+
+    const Skeleton& sk = *m_skeleton;
+    float*          w  = m_world;
+    for (; i < last; i++) {
+        const float* local[4];
+        if (edited) {
+            for (int f = f0; f < f1; f++) {
+                const glm::quat q = localQ(i, f);
+                scratch[0][f - f0] = q.w;
+                scratch[1][f - f0] = q.x;
+                scratch[2][f - f0] = q.y;
+                scratch[3][f - f0] = q.z;
+            }
+            for (int c = 0; c < 4; c++) local[c] = scratch[c];
+        } else {
+            for (int c = 0; c < 4; c++) local[c] = base + c * m_plane + index(i, f0);
+        }
+        forwardFrames(fk::worldPlanes((const float*)w, m_plane, index(sk.parent[i], f0)), local,
+                      sk.offset[i], fk::worldPlanes(w, m_plane, index(i, f0)), n, isa);
+    }
+
+    std::fill(m_dirty + f0, m_dirty + f1, Span());
+}
+
+void MotionClip::updateWorld(bool parallel, QuatTracks::Isa isa) const {
+    if (m_numLinks == 0 || m_dirtyLo >= m_dirtyHi) return;
+    allocateWorld();
+
+    const int lo = m_dirtyLo, hi = m_dirtyHi;
+    const int numBlocks = (hi - lo + k_fkBlockFrames - 1) / k_fkBlockFrames;
+    auto runBlocks = [&](int b0, int b1) {
+        for (int b = b0; b < b1; b++)
+            updateFrames(lo + b * k_fkBlockFrames, std::min(lo + (b + 1) * k_fkBlockFrames, hi), isa);
+    };
+    if (parallel) ThreadPool::shared().parallelFor(numBlocks, 1, runBlocks);
+    else          runBlocks(0, numBlocks);
+
+    m_dirtyLo = m_dirtyHi = 0;
+}
+
+std::vector<glm::vec3>& MotionClip::displacement(int f) {
+    auto& d = m_displacement[f];
+    d.resize(m_numLinks + 1);
+    return d;
+}
@@ -0,0 +1,213 @@
+//
+// MotionClip.h
+// ConstraintBasedMotionEdit
+//
+// Pose storage for a whole clip. Instead of a Body with its own Link vector
+// per frame, all frames live in one structure-of-arrays store: local
+// rotations, world positions and world orientations, one float plane per
+// component, each laid out link-major ([link * numFrames + frame]) like
+// QuatTracks, so whole-clip passes such as FK (FKKernels.h, several frames
+// per instruction) or spline application walk every plane in order.
+// Body (IK.h) is a view of one frame of a clip.
+//
+// World transforms are a cache. Every change to the local pose marks the
+// affected subtree of that frame dirty, and FK runs only when a dirty
+// transform is read (or for all dirty frames at once in updateWorld), so
+// frames that did not change are never recomputed.
+//
+// The fixed-size planes of a clip are carved from one Arena block sized at
+// create / createLayer, so building a clip is a single heap allocation and
+// clearing it a single release.
+//
+// A clip is either a base clip, which owns its local pose, or an edit layer
+// over a shared, immutable base. A layer stores only what editing changed:
+// a B-spline displacement track (motionEdit) and whole-frame overrides for
+// frames posed directly (IK). Everything else reads through to the base.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Arena.h"
+#include "QuatTracks.h"
+
+// Topology and scaled rest offsets, shared by every clip of one skeleton.
+// Links are in depth-first order (a parent precedes its children).
+struct Skeleton {
+    std::vector<int>       parent;   // -1 for the root
+    std::vector<int>       child;    // first child, -1 for leaves
+    std::vector<int>       subtreeEnd;   // subtree of i is [i, subtreeEnd[i])
+    std::vector<uint8_t>   isEnd;    // End Site joints
+    std::vector<uint8_t>   limbEnd;  // ankle / wrist below a knee / elbow (two-bone IK); may be empty
+    std::vector<glm::vec3> offset;   // local offset from the parent (unused for the root)
+
+    int size() const { return (int)parent.size(); }
+};
+
+// Per-link rotation displacement as a cubic uniform B-spline over frames
+// (fitted by motionEdit). Applied as q * quat(1, d), left unnormalized.
+struct DisplacementTrack {
+    int                    space    = 5;   // frames per knot interval
+    int                    controlN = 0;   // 0 = no track
+    std::vector<glm::vec3> control;        // [link * controlN + k]
+
+    // Frames whose spline stencil is complete: [firstFrame, endFrame)
+    int  firstFrame() const { return space; }
+    int  endFrame()   const { return controlN > 2 ? (controlN - 2) * space : 0; }
+    bool covers(int f) const {
+        const int k = f / space;
+        return controlN > 0 && k >= 1 && k <= controlN - 3;
+    }
+
+    glm::quat apply(const glm::quat& q, int link, int f) const {
+        if (!covers(f)) return q;
+        const float      t = (f % space) / (float)space;
+        const glm::vec3* b = control.data() + (size_t)link * controlN + f / space;
+        glm::vec3 bspline =
+            b[-1] * (1.f/6.f) * (1-t)*(1-t)*(1-t) +
+            b[ 0] * (1.f/6.f) * (3*t*t*t - 6*t*t + 4) +
+            b[ 1] * (1.f/6.f) * (-3*t*t*t + 3*t*t + 3*t + 1) +
+            b[ 2] * (1.f/6.f) * t*t*t;
+        return q * glm::quat(1.f, bspline.x, bspline.y, bspline.z);
+    }
+};
+
+class MotionClip {
+public:
+    // Base clip: numFrames identity poses (root at the origin).
+    void create(std::shared_ptr<const Skeleton> skeleton, int numFrames);
+    // Edit layer over base with no edits yet; reads equal the base.
+    void createLayer(std::shared_ptr<const MotionClip> base);
+    void clear();
+
+    bool            empty()     const { return m_numFrames == 0; }
+    int             numFrames() const { return m_numFrames; }
+    int             numLinks()  const { return m_numLinks; }
+    const Skeleton& skeleton()  const { return *m_skeleton; }
+    const std::shared_ptr<const Skeleton>& sharedSkeleton() const { return m_skeleton; }
+
+    bool              isLayer() const { return m_base != nullptr; }
+    const MotionClip* base()    const { return m_base.get(); }
+    // Drops every edit of a layer (track, overrides, displacements).
+    void resetLayer();
+
+    // Local pose: root position and per-link rotation. Root positions are
+    // never edited, so only base clips can set them.
+    glm::vec3 rootPos(int f) const { return m_base ? m_base->rootPos(f) : m_rootPos[f]; }
+    void      setRootPos(int f, const glm::vec3& p) { m_rootPos[f] = p; invalidate(f, 0, m_numLinks); }
+
+    glm::quat localQ(int link, int f) const {
+        if (!m_base) return loadQ(m_localQ, index(link, f));
+        const int slot = m_overrideSlot[f];
+        if (slot >= 0) return m_overrideQ[(size_t)slot * m_numLinks + link];
+        return m_track.apply(m_base->localQ(link, f), link, f);
+    }
+    // On a layer, the first write to a frame copies its current pose into
+    // an override (copy-on-write).
+    void setLocalQ(int link, int f, const glm::quat& q);
+
+    // Layers only: replaces the displacement track. Overrides of frames the
+    // new track covers are dropped, as the track now defines those frames,
+    // unless dropCovered is false (EditHistory restoring an earlier state).
+    void setDisplacementTrack(DisplacementTrack track, bool dropCovered = true);
+    const DisplacementTrack& displacementTrack() const { return m_track; }
+    int  numOverrides() const { return m_numLinks ? (int)(m_overrideQ.size() / m_numLinks) : 0; }
+
+    // Layers only: the override of frame f (numLinks rotations), or nullptr
+    // when the frame reads through to the base.
+    const glm::quat* overrideRow(int f) const {
+        const int slot = m_base ? m_overrideSlot[f] : -1;
+        return slot >= 0 ? m_overrideQ.data() + (size_t)slot * m_numLinks : nullptr;
+    }
+    // Sets the override of frame f to row, or drops it when row is nullptr
+    // (the last override moves into the freed slot).
+    void setOverrideRow(int f, const glm::quat* row);
+
+    // World transforms, brought up to date on read. The planes are only
+    // allocated by the first FK pass, so a clip that is only read for its
+    // local pose (the original motion) never pays for them.
+    glm::vec3 worldP(int link, int f) const {
+        resolve(f);
+        const size_t i = index(link, f);
+        return glm::vec3(m_world[i], m_world[m_plane + i], m_world[2 * m_plane + i]);
+    }
+    glm::quat worldQ(int link, int f) const { resolve(f); return loadQ(m_world + 3 * m_plane, index(link, f)); }
+
+    // Recomputes links [first, last) of frame f now, together with anything
+    // else dirty in that frame.
+    void updateWorld(int f, int first, int last);
+    // Brings every dirty frame up to date. Frames are split into blocks of
+    // k_fkBlockFrames, run on ThreadPool::shared() when parallel; each block
+    // walks its frames a link plane at a time with the isa FK kernel (blocks
+    // with only a few dirty frames go frame by frame). Every frame is
+    // computed the same way whatever the split, so the result is
+    // deterministic.
+    static constexpr int k_fkBlockFrames = 256;
+    void updateWorld(bool parallel = true, QuatTracks::Isa isa = QuatTracks::bestIsa()) const;
+
+    // Marks links [first, last) of frame f, or all links of frames [f0, f1),
+    // for recomputation. Local pose setters do this themselves.
+    void invalidate(int f, int first, int last);
+    void invalidateFrames(int f0, int f1);
+    bool isDirty(int f) const { return m_dirty[f].begin < m_dirty[f].end; }
+
+    // Per-frame displacement from the base motion: row 0 is the root
+    // translation, row i + 1 the log-map rotation of link i. Only constrained
+    // frames have one, so a frame is constrained iff it has a displacement.
+    std::vector<glm::vec3>& displacement(int f);
+    const std::map<int, std::vector<glm::vec3>>& displacements() const { return m_displacement; }
+    void clearDisplacements() { m_displacement.clear(); }
+    void eraseDisplacement(int f) { m_displacement.erase(f); }
+    void setDisplacements(std::map<int, std::vector<glm::vec3>> d) { m_displacement = std::move(d); }
+
+    // Heap use of the clip's planes since create / createLayer (not counting
+    // overrides, which grow with editing)
+    const Arena::Stats& arenaStats() const { return m_arena.stats(); }
+
+private:
+    // Dirty links of one frame: the hull of the invalidated subtrees
+    struct Span { int begin = 0, end = 0; };
+
+    size_t index(int link, int f) const { return (size_t)link * m_numFrames + f; }
+    // Quaternion from four planes (w, x, y, z) of m_plane floats each
+    glm::quat loadQ(const float* planes, size_t i) const {
+        return glm::quat(planes[i], planes[m_plane + i], planes[2 * m_plane + i], planes[3 * m_plane + i]);
+    }
+    void   allocateWorld() const;
+    void   resolve(int f) const { if (isDirty(f)) updateFrame(f); }
+    void   updateFrame(int f) const;
+    void   updateFrames(int f0, int f1, QuatTracks::Isa isa) const;
+    void   updateRoot(int f) const;
+
+    std::shared_ptr<const Skeleton>   m_skeleton;
+    std::shared_ptr<const MotionClip> m_base;   // layers only
+    int                    m_numFrames = 0;
+    int                    m_numLinks  = 0;
+    size_t                 m_plane     = 0;   // numLinks * numFrames
+
+    // Owns every plane below; mutable for the lazily allocated world planes
+    mutable Arena          m_arena;
+
+    // Base clips
+    glm::vec3*             m_rootPos = nullptr;   // [frame]
+    float*                 m_localQ  = nullptr;   // planes w, x, y, z: [c * m_plane + link * numFrames + frame]
+
+    // Layers
+    DisplacementTrack      m_track;
+    int*                   m_overrideSlot = nullptr;   // [frame] -> override slot, -1 = none
+    std::vector<glm::quat> m_overrideQ;                // [slot * numLinks + link]
+
+    // World transform cache
+    mutable float*                 m_world   = nullptr;  // planes px, py, pz, qw, qx, qy, qz
+    mutable Span*                  m_dirty   = nullptr;  // [frame]
+    mutable int                    m_dirtyLo = 0;        // frames [lo, hi) hold every dirty one
+    mutable int                    m_dirtyHi = 0;
+
+    std::map<int, std::vector<glm::vec3>> m_displacement;   // by frame
+};
@@ -0,0 +1,166 @@
+//
+// MotionEdit.cpp
+// ConstraintBasedMotionEdit
+//
+// IK constraints and cubic uniform B-spline displacement fitting.
+//
+
+#include "MotionEdit.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <glm/gtx/quaternion.hpp>
+
+void buildClip(BVH& bvh, float scale, MotionClip& edited) {
+    auto origin = std::make_shared<MotionClip>();
+    origin->create(bvh.MakeSkeleton(scale), bvh.num_frame);
+    for (int i = 0; i < bvh.num_frame; i++)
+        bvh.UpdatePose(i, Body(*origin, i), scale);
+
+    edited.createLayer(std::move(origin));
+}
+
+void applyConstraint(Body edited, int joint, const glm::vec3& target) {
+    // IK leaves the rotated subtrees dirty; reading the root below refreshes
+    // exactly those
+    edited.solveIK(joint, target);
+    edited.getDisplacement();   // marks the frame constrained
+}
+
+void applyConstraints(Body edited, const std::vector<IKEffector>& targets) {
+    edited.solveIK(targets);
+    edited.getDisplacement();
+}
+
+RangeStats applyConstraintRange(MotionClip& edited, int joint, int first, int last, const glm::vec3& target,
+                                const IKOptions& options, bool parallel) {
+    RangeStats stats;
+    first = std::max(first, 0);
+    last  = std::min(last, edited.numFrames() - 1);
+    if (first > last || joint <= 0 || joint >= edited.numLinks()) return stats;
+
+    // The links IK moves: the joint's ancestors but the root
+    const Skeleton&  sk = edited.skeleton();
+    std::vector<int> chain;
+    for (int i = sk.parent[joint]; i > 0; i = sk.parent[i]) chain.push_back(i);
+    const int n = (int)chain.size();
+
+    // Blocks only read the clip and write their own rows of solved / stat,
+    // so they share nothing
+    const int              count = last - first + 1;
+    std::vector<glm::quat> solved((size_t)count * n);
+    std::vector<IKStats>   stat(count);
+    auto runBlocks = [&](int b0, int b1) {
+        MotionClip scratch;
+        scratch.create(edited.sharedSkeleton(), k_rangeBlockFrames);
+        for (int b = b0; b < b1; b++) {
+            const int f0 = first + b * k_rangeBlockFrames;
+            const int f1 = std::min(f0 + k_rangeBlockFrames, last + 1);
+            for (int f = f0; f < f1; f++) {
+                const int i = f - f0;
+                // IK reads only the root and the chain; warm start: carry the
+                // previous frame's correction over
+                scratch.setRootPos(i, edited.rootPos(f));
+                scratch.setLocalQ(0, i, edited.localQ(0, f));
+                for (int k = 0; k < n; k++) {
+                    glm::quat q = edited.localQ(chain[k], f);
+                    if (i > 0) q = glm::normalize(q * glm::inverse(edited.localQ(chain[k], f - 1)) * scratch.localQ(chain[k], i - 1));
+                    scratch.setLocalQ(chain[k], i, q);
+                }
+
+                stat[f - first] = Body(scratch, i).solveIK(joint, target, options);
+                for (int k = 0; k < n; k++)
+                    solved[(size_t)(f - first) * n + k] = scratch.localQ(chain[k], i);
+            }
+        }
+    };
+    const int numBlocks = (count + k_rangeBlockFrames - 1) / k_rangeBlockFrames;
+    if (parallel) ThreadPool::shared().parallelFor(numBlocks, 1, runBlocks);
+    else          runBlocks(0, numBlocks);
+
+    for (int f = first; f <= last; f++) {
+        Body body(edited, f);
+        for (int k = 0; k < n; k++) body.setQ(chain[k], solved[(size_t)(f - first) * n + k]);
+        body.getDisplacement();   // marks the frame constrained
+
+        const IKStats& s = stat[f - first];
+        stats.frames++;
+        stats.converged  += s.converged;
+        stats.iterations += s.iterations;
+        stats.maxError    = std::max(stats.maxError, s.error);
+    }
+    return stats;
+}
+
+// For each joint, fits a B-spline through the constrained displacement frames;
+// the layer then applies the curve to all frames to produce smooth motion.
+int motionEdit(MotionClip& edited) {
+    const int totalFrame = edited.numFrames();
+
+    const auto&      disp = edited.displacements();
+    std::vector<int> cons;
+    for (const auto& entry : disp)
+        cons.push_back(entry.first);
+    if (cons.empty()) return 0;
+
+    const int   space    = 5;
+    const int   controlN = totalFrame / space + 1;
+    const int   numLinks = edited.numLinks();
+
+    DisplacementTrack track;
+    track.space    = space;
+    track.controlN = controlN;
+    track.control.resize((size_t)numLinks * controlN);
+
+    // The basis depends only on the constrained frames, so one SVD serves
+    // every joint
+    Eigen::MatrixXf basis = Eigen::MatrixXf::Zero(controlN, (int)cons.size());
+    for (int j = 0; j < (int)cons.size(); j++) {
+        int   f = cons[j];
+        float t = (f % space) / (float)space;
+        int   k = f / space;
+
+        // Skip boundary cases where B-spline stencil is incomplete
+        if (k < 1 || k > controlN - 4) continue;
+
+        // Cubic uniform B-spline basis (de Boor)
+        basis(k - 1, j) = (1.f/6.f) * (1-t)*(1-t)*(1-t);
+        basis(k,     j) = (1.f/6.f) * (3*t*t*t - 6*t*t + 4);
+        basis(k + 1, j) = (1.f/6.f) * (-3*t*t*t + 3*t*t + 3*t + 1);
+        basis(k + 2, j) = (1.f/6.f) * t*t*t;
+    }
+
+    // Displacements of all joints, three rows each: p(3 * (joint - 1) + c, j)
+    Eigen::MatrixXf p = Eigen::MatrixXf::Zero(3 * numLinks, (int)cons.size());
+    for (int j = 0; j < (int)cons.size(); j++) {
+        if (basis.col(j).isZero()) continue;   // skipped above
+        const std::vector<glm::vec3>& d = disp.at(cons[j]);
+        for (int joint = 1; joint < numLinks + 1; joint++) {
+            p(3 * (joint - 1) + 0, j) = d[joint].x;
+            p(3 * (joint - 1) + 1, j) = d[joint].y;
+            p(3 * (joint - 1) + 2, j) = d[joint].z;
+        }
+    }
+
+    // Solve for B-spline control points via SVD pseudo-inverse: b = p * B^+,
+    // applied through its factors (B^+ = V S^-1 U^T over the kept singular
+    // values) so no controlN x controlN matrix is formed
+    auto solver = basis.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV);
+    solver.setThreshold(0.01f);
+    const int       rank = (int)solver.rank();
+    Eigen::MatrixXf pV   = p * solver.matrixV().leftCols(rank);
+    pV *= solver.singularValues().head(rank).cwiseInverse().asDiagonal();
+    Eigen::MatrixXf b    = pV * solver.matrixU().leftCols(rank).transpose();
+
+    for (int joint = 1; joint < numLinks + 1; joint++) {
+        glm::vec3* control = &track.control[(size_t)(joint - 1) * controlN];
+        for (int k = 0; k < controlN; k++)
+            control[k] = glm::vec3(b(3 * (joint - 1), k), b(3 * (joint - 1) + 1, k), b(3 * (joint - 1) + 2, k));
+    }
+
+    edited.setDisplacementTrack(std::move(track));
+    edited.clearDisplacements();
+
+    return (int)cons.size();
+}
@@ -0,0 +1,66 @@
+//
+// MotionEdit.h
+// ConstraintBasedMotionEdit
+//
+// Constraint-based motion editing shared by the viewer and the batch tool.
+// The edited clip is a MotionClip edit layer over the original motion.
+// Constraints are IK drags on single frames, or one joint held in place over
+// a frame range; motionEdit() spreads their displacements over the clip with
+// a cubic uniform B-spline.
+//
+// Reference: "Retargetting Motion to New Characters" — Gleicher et al.
+//            Cubic uniform B-spline: knot interval = 5 frames
+//
+
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "IK.h"
+
+class BVH;
+
+struct EditConstraint {
+    int       frame  = 0;
+    int       last   = 0;             // range constraints: last frame, inclusive (== frame for one frame)
+    int       joint  = 0;             // link index (== BVH joint index)
+    glm::vec3 target = glm::vec3(0);  // world position, Body units (BVH units * scale)
+};
+
+// Of one applyConstraintRange
+struct RangeStats {
+    int   frames     = 0;
+    int   converged  = 0;     // frames within the IK tolerance
+    int   iterations = 0;     // summed over the frames
+    float maxError   = 0.f;
+};
+
+// Poses every frame of bvh into a new base clip and opens edited as an
+// empty edit layer over it. World transforms are computed when first read.
+// Streaming clips are not supported.
+void buildClip(BVH& bvh, float scale, MotionClip& edited);
+
+// Moves one joint of an edited frame to target with IK and records the
+// frame's displacement from the base pose. Same as an interactive drag in
+// the viewer.
+void applyConstraint(Body edited, int joint, const glm::vec3& target);
+// Several joints of one frame, solved together (multi-effector IK) so each
+// keeps its target
+void applyConstraints(Body edited, const std::vector<IKEffector>& targets);
+
+// Holds joint at target on every frame of [first, last] (a foot plant, a
+// hand on a rail) and marks those frames constrained. The range is cut into
+// blocks of k_rangeBlockFrames solved in parallel (ThreadPool::shared())
+// on private copies of their frames; within a block each frame starts from
+// the previous frame's correction, so consecutive solves take a step or two
+// and stay coherent. The blocks are fixed, so the result does not depend on
+// the thread count. The solved rotations are written to the clip afterwards.
+static constexpr int k_rangeBlockFrames = 32;
+RangeStats applyConstraintRange(MotionClip& edited, int joint, int first, int last, const glm::vec3& target,
+                                const IKOptions& options = IKOptions(), bool parallel = true);
+
+// Fits the B-spline through every frame constrained by applyConstraint and
+// makes it the layer's displacement track, then clears the constraints.
+// Returns the number of constrained frames (0 = nothing was changed).
+int motionEdit(MotionClip& edited);
@@ -0,0 +1,130 @@
+//
+// MotionStream.cpp
+// ConstraintBasedMotionEdit
+//
+// Frame-line index, window decoding and read-ahead thread.
+//
+
+#include "MotionStream.h"
+#include "BVHText.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+MotionStream::MotionStream(std::shared_ptr<MappedFile> file, const char* motionBegin,
+                           int numFrame, int numChannel, int window)
+    : m_file(std::move(file)), m_numFrame(numFrame), m_numChannel(numChannel) {
+    m_window = std::max(1, std::min(window, numFrame));
+
+    // Index frame lines once; missing trailing lines decode as zeros
+    const char* p   = motionBegin;
+    const char* end = m_file->end();
+    m_line.reserve((size_t)numFrame + 1);
+    while ((int)m_line.size() < numFrame && p < end) {
+        m_line.push_back(p);
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+    m_line.push_back(p);
+
+    m_front.assign((size_t)m_window * numChannel, 0.0);
+    m_back.assign((size_t)m_window * numChannel, 0.0);
+
+    m_worker = std::thread([this] { workerLoop(); });
+}
+
+MotionStream::~MotionStream() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    m_worker.join();
+}
+
+size_t MotionStream::residentBytes() const {
+    return (m_front.size() + m_back.size()) * sizeof(double) + m_line.size() * sizeof(const char*);
+}
+
+int MotionStream::clampStart(int start) const {
+    return std::max(0, std::min(start, m_numFrame - m_window));
+}
+
+void MotionStream::decode(int start, double* out) const {
+    const int numLines = (int)m_line.size() - 1;
+    std::fill(out, out + (size_t)m_window * m_numChannel, 0.0);
+    for (int i = 0; i < m_window; i++) {
+        int f = start + i;
+        if (f >= numLines) break;
+        const char* b = m_line[f];
+        const char* e = m_line[f + 1];
+        if (e > b && e[-1] == '\n') e--;
+        bvhtext::parseFrameLine(b, e, out + (size_t)i * m_numChannel, m_numChannel);
+    }
+}
+
+void MotionStream::decodeAll(double* out) const {
+    const int numLines = (int)m_line.size() - 1;
+    for (int f = 0; f < numLines; f++) {
+        const char* b = m_line[f];
+        const char* e = m_line[f + 1];
+        if (e > b && e[-1] == '\n') e--;
+        bvhtext::parseFrameLine(b, e, out + (size_t)f * m_numChannel, m_numChannel);
+    }
+}
+
+const double* MotionStream::frame(int f) {
+    if (inWindow(m_frontStart, f))
+        return m_front.data() + (size_t)(f - m_frontStart) * m_numChannel;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_backState != BackState::Empty && inWindow(m_backStart, f)) {
+            // Read-ahead already covers f: wait for it rather than decode twice
+            m_cv.wait(lock, [this] { return m_backState == BackState::Ready; });
+            std::swap(m_front, m_back);
+            m_frontStart = m_backStart;
+            m_backStart  = -1;
+            m_backState  = BackState::Empty;
+            return m_front.data() + (size_t)(f - m_frontStart) * m_numChannel;
+        }
+    }
+
+    // Scrub or cold start: decode synchronously, keeping a little history
+    m_frontStart = clampStart(f - m_window / 4);
+    decode(m_frontStart, m_front.data());
+    return m_front.data() + (size_t)(f - m_frontStart) * m_numChannel;
+}
+
+void MotionStream::prefetch(int f) {
+    int ahead = f + m_window / 2;
+    if (ahead >= m_numFrame) ahead -= m_numFrame;   // playback loops back to 0
+    if (ahead < 0 || ahead >= m_numFrame || inWindow(m_frontStart, ahead)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_backState == BackState::Pending) return;
+        if (m_backState == BackState::Ready && inWindow(m_backStart, ahead)) return;
+        m_backStart = clampStart(ahead - m_window / 2);
+        m_backState = BackState::Pending;
+    }
+    m_cv.notify_all();
+}
+
+void MotionStream::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cv.wait(lock, [this] { return m_quit || m_backState == BackState::Pending; });
+        if (m_quit) return;
+
+        // m_back and m_backStart are not touched by the consumer while pending
+        int start = m_backStart;
+        lock.unlock();
+        decode(start, m_back.data());
+        lock.lock();
+
+        m_backState = BackState::Ready;
+        m_cv.notify_all();
+    }
+}
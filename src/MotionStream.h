@@ -0,0 +1,70 @@
+//
+// MotionStream.h
+// ConstraintBasedMotionEdit
+//
+// Windowed access to the MOTION block of a mapped BVH file.
+// Frame-line offsets are indexed once; only a sliding window of decoded
+// frames is kept in memory, and a read-ahead thread decodes the next
+// window while playback is still inside the current one.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class MappedFile;
+
+class MotionStream {
+public:
+    // [motionBegin, file->end()) holds one frame per line.
+    MotionStream(std::shared_ptr<MappedFile> file, const char* motionBegin,
+                 int numFrame, int numChannel, int window);
+    ~MotionStream();
+
+    MotionStream(const MotionStream&)            = delete;
+    MotionStream& operator=(const MotionStream&) = delete;
+
+    // Channel values of frame f. Valid until the next frame() call; only one
+    // thread may read frames.
+    const double* frame(int f);
+
+    // Playback hint: the caller is at frame f and moving forward (looping).
+    // Starts decoding the next window in the background if needed.
+    void prefetch(int f);
+
+    // Decodes every frame into out (num_frame * num_channel).
+    void decodeAll(double* out) const;
+
+    int    window()        const { return m_window; }
+    size_t residentBytes() const;
+
+private:
+    enum class BackState { Empty, Pending, Ready };
+
+    std::shared_ptr<MappedFile> m_file;
+    std::vector<const char*>    m_line;        // [frame] start of frame line, plus end
+    int                         m_numFrame   = 0;
+    int                         m_numChannel = 0;
+    int                         m_window     = 0;
+
+    std::vector<double> m_front;               // consumer-owned window
+    int                 m_frontStart = -1;
+    std::vector<double> m_back;                // filled by the read-ahead thread
+    int                 m_backStart  = -1;
+    BackState           m_backState  = BackState::Empty;
+
+    std::thread             m_worker;
+    std::mutex              m_mutex;
+    std::condition_variable m_cv;
+    bool                    m_quit = false;
+
+    int  clampStart(int start) const;
+    bool inWindow(int start, int f) const { return start >= 0 && f >= start && f < start + m_window; }
+    void decode(int start, double* out) const;
+    void workerLoop();
+};
@@ -0,0 +1,110 @@
+//
+// QuatTracks.cpp
+// ConstraintBasedMotionEdit
+//
+// Load-time Euler -> quaternion conversion: ISA dispatch, scalar and SSE2
+// paths, and the frame-block loop over the clip.
+//
+
+#include "QuatTracks.h"
+#include "BVH.h"
+#include "EulerKernels.h"
+#include "SimdMath.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+bool simd::hasAvx2() {
+#if defined(SIMD_X64) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;   // OS saves YMM state
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(SIMD_X64) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+QuatTracks::Isa QuatTracks::bestIsa() {
+    static const Isa isa = [] {
+#ifdef SIMD_X64
+        if (avx2Built() && simd::hasAvx2()) return Isa::Avx2;
+        return Isa::Sse2;
+#else
+        return Isa::Scalar;
+#endif
+    }();
+    return isa;
+}
+
+const char* QuatTracks::isaName(Isa isa) {
+    switch (isa) {
+    case Isa::Avx2: return "AVX2";
+    case Isa::Sse2: return "SSE2";
+    default:        return "scalar";
+    }
+}
+
+void QuatTracks::convert(const double* motion, int numChannel,
+                         const int* channel, const int* axis, int numRot,
+                         int f0, int f1, float* w, float* x, float* y, float* z, Isa isa) {
+    if (isa == Isa::Avx2) {
+        convertAvx2(motion, numChannel, channel, axis, numRot, f0, f1, w, x, y, z);
+        return;
+    }
+    euler::withOrder(axis, numRot, [&](auto order) {
+        using Order = decltype(order);
+#ifdef SIMD_X64
+        if (isa == Isa::Sse2) {
+            euler::convertFrames<simd::Sse4, simd::Float1, Order>(motion, numChannel, channel, axis, f0, f1, w, x, y, z);
+            return;
+        }
+#endif
+        euler::convertFrames<simd::Float1, simd::Float1, Order>(motion, numChannel, channel, axis, f0, f1, w, x, y, z);
+    });
+}
+
+void QuatTracks::build(const BVH& bvh, bool parallel, Isa isa) {
+    clear();
+    const double* motion = bvh.FrameData(0);
+    if (!motion || bvh.IsStreaming() || bvh.num_frame == 0 || bvh.joints.empty()) return;
+
+    m_numFrame  = bvh.num_frame;
+    m_numJoints = (int)bvh.joints.size();
+    m_plane     = (size_t)m_numFrame * m_numJoints;
+    m_data.resize(4 * m_plane);
+
+    const int numBlocks = (m_numFrame + k_blockFrames - 1) / k_blockFrames;
+    auto convertBlocks = [&](int b0, int b1) {
+        for (int b = b0; b < b1; b++) {
+            const int f0 = b * k_blockFrames;
+            const int f1 = std::min(f0 + k_blockFrames, m_numFrame);
+            for (const auto& joint : bvh.joints) {
+                float* w = m_data.data() + (size_t)joint.index * m_numFrame;
+                convert(motion, bvh.num_channel, joint.rot_channel, joint.rot_axis, joint.num_rot,
+                        f0, f1, w, w + m_plane, w + 2 * m_plane, w + 3 * m_plane, isa);
+            }
+        }
+    };
+
+    if (parallel) ThreadPool::shared().parallelFor(numBlocks, 1, convertBlocks);
+    else          convertBlocks(0, numBlocks);
+}
+
+void QuatTracks::clear() {
+    m_numFrame  = 0;
+    m_numJoints = 0;
+    m_plane     = 0;
+    std::vector<float>().swap(m_data);
+}
@@ -0,0 +1,74 @@
+//
+// QuatTracks.h
+// ConstraintBasedMotionEdit
+//
+// Local joint rotations of a whole clip, converted once from the Euler
+// channels at load time. Storage is SoA: four component planes (w, x, y, z),
+// each joint-major, so track j of a plane is numFrame consecutive floats.
+// The conversion runs the EulerKernels formulas over 8 (AVX2) or 4 (SSE2)
+// frames at a time, with a scalar fallback.
+//
+
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class BVH;
+
+class QuatTracks {
+public:
+    enum class Isa { Scalar, Sse2, Avx2 };
+
+    // Frames converted per block; every joint is converted before moving on,
+    // so the block's channel rows stay in cache while their columns are read.
+    static constexpr int k_blockFrames = 256;
+
+    // Widest instruction set this CPU and build support.
+    static Isa         bestIsa();
+    static const char* isaName(Isa isa);
+
+    // Converts every joint of a fully loaded clip (not streaming or
+    // compressed). parallel splits the frames over ThreadPool::shared().
+    void build(const BVH& bvh, bool parallel, Isa isa = bestIsa());
+    void clear();
+
+    // Frames [f0, f1) of one joint's rotation channels (see BVH::Joint) from
+    // frame-major channel data into the four planes of its track.
+    static void convert(const double* motion, int numChannel,
+                        const int* channel, const int* axis, int numRot,
+                        int f0, int f1, float* w, float* x, float* y, float* z, Isa isa);
+
+    bool   empty()     const { return m_numFrame == 0; }
+    int    numFrame()  const { return m_numFrame; }
+    int    numJoints() const { return m_numJoints; }
+    size_t bytes()     const { return m_data.size() * sizeof(float); }
+
+    glm::quat get(int joint, int frame) const {
+        const size_t i = (size_t)joint * m_numFrame + frame;
+        return glm::quat(m_data[i], m_data[m_plane + i], m_data[2 * m_plane + i], m_data[3 * m_plane + i]);
+    }
+    void set(int joint, int frame, const glm::quat& q) {
+        const size_t i = (size_t)joint * m_numFrame + frame;
+        m_data[i]                = q.w;
+        m_data[m_plane + i]      = q.x;
+        m_data[2 * m_plane + i]  = q.y;
+        m_data[3 * m_plane + i]  = q.z;
+    }
+
+    // Component c (0 = w, 1 = x, 2 = y, 3 = z) of one joint's track.
+    const float* track(int c, int joint) const { return m_data.data() + c * m_plane + (size_t)joint * m_numFrame; }
+
+private:
+    int                m_numFrame  = 0;
+    int                m_numJoints = 0;
+    size_t             m_plane     = 0;   // floats per component plane
+    std::vector<float> m_data;            // [c * m_plane + joint * numFrame + frame]
+
+    // AVX2 instantiation, built in its own TU (QuatTracksAvx2.cpp)
+    static bool avx2Built();
+    static void convertAvx2(const double* motion, int numChannel,
+                            const int* channel, const int* axis, int numRot,
+                            int f0, int f1, float* w, float* x, float* y, float* z);
+};
@@ -0,0 +1,33 @@
+//
+// QuatTracksAvx2.cpp
+// ConstraintBasedMotionEdit
+//
+// AVX2 instantiation of the QuatTracks converter. This file alone is built
+// with /arch:AVX2 (see the vcxproj); QuatTracks::bestIsa only picks it when
+// the CPU reports AVX2. Without AVX2 code generation it forwards to SSE2.
+//
+
+#include "QuatTracks.h"
+#include "EulerKernels.h"
+#include "SimdMath.h"
+
+bool QuatTracks::avx2Built() {
+#if defined(SIMD_X64) && defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void QuatTracks::convertAvx2(const double* motion, int numChannel,
+                             const int* channel, const int* axis, int numRot,
+                             int f0, int f1, float* w, float* x, float* y, float* z) {
+#if defined(SIMD_X64) && defined(__AVX2__)
+    euler::withOrder(axis, numRot, [&](auto order) {
+        euler::convertFrames<simd::Avx8, simd::Float1, decltype(order)>(
+            motion, numChannel, channel, axis, f0, f1, w, x, y, z);
+    });
+#else
+    convert(motion, numChannel, channel, axis, numRot, f0, f1, w, x, y, z, Isa::Sse2);
+#endif
+}
@@ -0,0 +1,233 @@
+//
+// SimdMath.h
+// ConstraintBasedMotionEdit
+//
+// Minimal float lane types for batch kernels, all with the same interface:
+//   Float1  plain float (fallback, loop tails)
+//   Sse4    4 x float, SSE2 (baseline on x64)
+//   Avx8    8 x float, AVX2 (only where the TU is built with AVX2,
+//           see QuatTracksAvx2.cpp; selected at run time via hasAvx2())
+// Each type provides + - * with lanes and floats, load/store, a strided
+// gather of doubles and sincos(), so templated kernels compile for all.
+// For kernels with per-lane control flow (IKKernels.h) they also provide
+// / sqrt max, and masks: a lane type with every bit of the lane set where
+// true (lessThan), combined with & | andNot and consumed by select() and
+// anyTrue().
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SIMD_X64 1
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+// sincos on [-pi/4, pi/4] after reduction by pi/2 (Cephes single precision);
+// about 1e-7 absolute error for |x| up to a few thousand radians.
+constexpr float k_2overPi = 0.63661977236f;
+constexpr float k_piO2a   = 1.5703125f;
+constexpr float k_piO2b   = 4.837512969970703125e-4f;
+constexpr float k_piO2c   = 7.54978995489188216e-8f;
+constexpr float k_sin0    = -1.9515295891e-4f;
+constexpr float k_sin1    = 8.3321608736e-3f;
+constexpr float k_sin2    = -1.6666654611e-1f;
+constexpr float k_cos0    = 2.443315711809948e-5f;
+constexpr float k_cos1    = -1.388731625493765e-3f;
+constexpr float k_cos2    = 4.166664568298827e-2f;
+
+// ---------------------------------------------------------------------------
+// Float1
+// ---------------------------------------------------------------------------
+struct Float1 {
+    static constexpr int width = 1;
+    float v;
+
+    Float1() = default;
+    explicit Float1(float f) : v(f) {}
+
+    static Float1 load(const float* p)                      { return Float1(*p); }
+    static Float1 gather(const double* p, int /*stride*/)   { return Float1((float)*p); }
+    void          store(float* p) const                     { *p = v; }
+};
+
+inline Float1 operator+(Float1 a, Float1 b) { return Float1(a.v + b.v); }
+inline Float1 operator-(Float1 a, Float1 b) { return Float1(a.v - b.v); }
+inline Float1 operator*(Float1 a, Float1 b) { return Float1(a.v * b.v); }
+inline Float1 operator*(float a, Float1 b)  { return Float1(a * b.v); }
+inline Float1 operator/(Float1 a, Float1 b) { return Float1(a.v / b.v); }
+inline Float1 sqrt(Float1 a)                { return Float1(std::sqrt(a.v)); }
+inline Float1 max(Float1 a, Float1 b)       { return Float1(a.v > b.v ? a.v : b.v); }
+
+inline uint32_t bitsOf(Float1 a)     { uint32_t u; std::memcpy(&u, &a.v, 4); return u; }
+inline Float1   fromBits(uint32_t u) { Float1 a; std::memcpy(&a.v, &u, 4); return a; }
+inline Float1 lessThan(Float1 a, Float1 b)          { return fromBits(a.v < b.v ? ~0u : 0u); }
+inline Float1 operator&(Float1 a, Float1 b)         { return fromBits(bitsOf(a) & bitsOf(b)); }
+inline Float1 operator|(Float1 a, Float1 b)         { return fromBits(bitsOf(a) | bitsOf(b)); }
+inline Float1 andNot(Float1 a, Float1 b)            { return fromBits(bitsOf(a) & ~bitsOf(b)); }
+inline Float1 select(Float1 mask, Float1 a, Float1 b) { return bitsOf(mask) ? a : b; }
+inline bool   anyTrue(Float1 mask)                  { return bitsOf(mask) != 0; }
+
+inline float flipSign(float f, uint32_t signBit) {
+    uint32_t u;
+    std::memcpy(&u, &f, 4);
+    u ^= signBit;
+    std::memcpy(&f, &u, 4);
+    return f;
+}
+
+inline void sincos(Float1 x, Float1& s, Float1& c) {
+    int   n = (int)std::lrint(x.v * k_2overPi);
+    float f = (float)n;
+    float r = ((x.v - f * k_piO2a) - f * k_piO2b) - f * k_piO2c;
+    float z = r * r;
+    float sr = ((k_sin0 * z + k_sin1) * z + k_sin2) * z * r + r;
+    float cr = ((k_cos0 * z + k_cos1) * z + k_cos2) * z * z - 0.5f * z + 1.f;
+    // Quadrant: swap on odd n, sign of sin flips for n & 2, of cos for (n + 1) & 2.
+    // Sign bits are xor'ed in like the vector versions (no data-dependent branches).
+    const bool odd = (n & 1) != 0;
+    s.v = flipSign(odd ? cr : sr, (uint32_t)(n & 2) << 30);
+    c.v = flipSign(odd ? sr : cr, (uint32_t)((n + 1) & 2) << 30);
+}
+
+#ifdef SIMD_X64
+
+// ---------------------------------------------------------------------------
+// Sse4
+// ---------------------------------------------------------------------------
+struct Sse4 {
+    static constexpr int width = 4;
+    __m128 v;
+
+    Sse4() = default;
+    explicit Sse4(__m128 m) : v(m) {}
+    explicit Sse4(float f) : v(_mm_set1_ps(f)) {}
+
+    static Sse4 load(const float* p) { return Sse4(_mm_loadu_ps(p)); }
+    static Sse4 gather(const double* p, int stride) {
+        return Sse4(_mm_setr_ps((float)p[0], (float)p[stride], (float)p[2 * stride], (float)p[3 * stride]));
+    }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline Sse4 operator+(Sse4 a, Sse4 b) { return Sse4(_mm_add_ps(a.v, b.v)); }
+inline Sse4 operator-(Sse4 a, Sse4 b) { return Sse4(_mm_sub_ps(a.v, b.v)); }
+inline Sse4 operator*(Sse4 a, Sse4 b) { return Sse4(_mm_mul_ps(a.v, b.v)); }
+inline Sse4 operator*(float a, Sse4 b) { return Sse4(_mm_mul_ps(_mm_set1_ps(a), b.v)); }
+inline Sse4 operator/(Sse4 a, Sse4 b)  { return Sse4(_mm_div_ps(a.v, b.v)); }
+inline Sse4 sqrt(Sse4 a)               { return Sse4(_mm_sqrt_ps(a.v)); }
+inline Sse4 max(Sse4 a, Sse4 b)        { return Sse4(_mm_max_ps(a.v, b.v)); }
+
+inline Sse4 lessThan(Sse4 a, Sse4 b)          { return Sse4(_mm_cmplt_ps(a.v, b.v)); }
+inline Sse4 operator&(Sse4 a, Sse4 b)         { return Sse4(_mm_and_ps(a.v, b.v)); }
+inline Sse4 operator|(Sse4 a, Sse4 b)         { return Sse4(_mm_or_ps(a.v, b.v)); }
+inline Sse4 andNot(Sse4 a, Sse4 b)            { return Sse4(_mm_andnot_ps(b.v, a.v)); }
+inline Sse4 select(Sse4 mask, Sse4 a, Sse4 b) { return Sse4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))); }
+inline bool anyTrue(Sse4 mask)                { return _mm_movemask_ps(mask.v) != 0; }
+
+inline void sincos(Sse4 x, Sse4& s, Sse4& c) {
+    const __m128  X = x.v;
+    const __m128i n = _mm_cvtps_epi32(_mm_mul_ps(X, _mm_set1_ps(k_2overPi)));
+    const __m128  f = _mm_cvtepi32_ps(n);
+    __m128 r = _mm_sub_ps(X, _mm_mul_ps(f, _mm_set1_ps(k_piO2a)));
+    r = _mm_sub_ps(r, _mm_mul_ps(f, _mm_set1_ps(k_piO2b)));
+    r = _mm_sub_ps(r, _mm_mul_ps(f, _mm_set1_ps(k_piO2c)));
+    const __m128 z = _mm_mul_ps(r, r);
+
+    __m128 sr = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k_sin0), z), _mm_set1_ps(k_sin1));
+    sr = _mm_add_ps(_mm_mul_ps(sr, z), _mm_set1_ps(k_sin2));
+    sr = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sr, z), r), r);
+    __m128 cr = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(k_cos0), z), _mm_set1_ps(k_cos1));
+    cr = _mm_add_ps(_mm_mul_ps(cr, z), _mm_set1_ps(k_cos2));
+    cr = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cr, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.f));
+
+    const __m128i one  = _mm_set1_epi32(1);
+    const __m128i two  = _mm_set1_epi32(2);
+    const __m128  swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(n, one), one));
+    const __m128  sv   = _mm_or_ps(_mm_and_ps(swap, cr), _mm_andnot_ps(swap, sr));
+    const __m128  cv   = _mm_or_ps(_mm_and_ps(swap, sr), _mm_andnot_ps(swap, cr));
+    // Bit 1 of n (resp. n + 1) moved into the float sign bit
+    const __m128  sSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(n, two), 30));
+    const __m128  cSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(n, one), two), 30));
+    s.v = _mm_xor_ps(sv, sSign);
+    c.v = _mm_xor_ps(cv, cSign);
+}
+
+#endif // SIMD_X64
+
+#if defined(SIMD_X64) && defined(__AVX2__)
+
+// ---------------------------------------------------------------------------
+// Avx8
+// ---------------------------------------------------------------------------
+struct Avx8 {
+    static constexpr int width = 8;
+    __m256 v;
+
+    Avx8() = default;
+    explicit Avx8(__m256 m) : v(m) {}
+    explicit Avx8(float f) : v(_mm256_set1_ps(f)) {}
+
+    static Avx8 load(const float* p) { return Avx8(_mm256_loadu_ps(p)); }
+    static Avx8 gather(const double* p, int stride) {
+        const __m128i idx = _mm_setr_epi32(0, stride, 2 * stride, 3 * stride);
+        __m128 lo = _mm256_cvtpd_ps(_mm256_i32gather_pd(p, idx, 8));
+        __m128 hi = _mm256_cvtpd_ps(_mm256_i32gather_pd(p + 4 * (size_t)stride, idx, 8));
+        return Avx8(_mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+    }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline Avx8 operator+(Avx8 a, Avx8 b) { return Avx8(_mm256_add_ps(a.v, b.v)); }
+inline Avx8 operator-(Avx8 a, Avx8 b) { return Avx8(_mm256_sub_ps(a.v, b.v)); }
+inline Avx8 operator*(Avx8 a, Avx8 b) { return Avx8(_mm256_mul_ps(a.v, b.v)); }
+inline Avx8 operator*(float a, Avx8 b) { return Avx8(_mm256_mul_ps(_mm256_set1_ps(a), b.v)); }
+inline Avx8 operator/(Avx8 a, Avx8 b)  { return Avx8(_mm256_div_ps(a.v, b.v)); }
+inline Avx8 sqrt(Avx8 a)               { return Avx8(_mm256_sqrt_ps(a.v)); }
+inline Avx8 max(Avx8 a, Avx8 b)        { return Avx8(_mm256_max_ps(a.v, b.v)); }
+
+inline Avx8 lessThan(Avx8 a, Avx8 b)          { return Avx8(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+inline Avx8 operator&(Avx8 a, Avx8 b)         { return Avx8(_mm256_and_ps(a.v, b.v)); }
+inline Avx8 operator|(Avx8 a, Avx8 b)         { return Avx8(_mm256_or_ps(a.v, b.v)); }
+inline Avx8 andNot(Avx8 a, Avx8 b)            { return Avx8(_mm256_andnot_ps(b.v, a.v)); }
+inline Avx8 select(Avx8 mask, Avx8 a, Avx8 b) { return Avx8(_mm256_blendv_ps(b.v, a.v, mask.v)); }
+inline bool anyTrue(Avx8 mask)                { return _mm256_movemask_ps(mask.v) != 0; }
+
+inline void sincos(Avx8 x, Avx8& s, Avx8& c) {
+    const __m256  X = x.v;
+    const __m256i n = _mm256_cvtps_epi32(_mm256_mul_ps(X, _mm256_set1_ps(k_2overPi)));
+    const __m256  f = _mm256_cvtepi32_ps(n);
+    __m256 r = _mm256_sub_ps(X, _mm256_mul_ps(f, _mm256_set1_ps(k_piO2a)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(f, _mm256_set1_ps(k_piO2b)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(f, _mm256_set1_ps(k_piO2c)));
+    const __m256 z = _mm256_mul_ps(r, r);
+
+    __m256 sr = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(k_sin0), z), _mm256_set1_ps(k_sin1));
+    sr = _mm256_add_ps(_mm256_mul_ps(sr, z), _mm256_set1_ps(k_sin2));
+    sr = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sr, z), r), r);
+    __m256 cr = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(k_cos0), z), _mm256_set1_ps(k_cos1));
+    cr = _mm256_add_ps(_mm256_mul_ps(cr, z), _mm256_set1_ps(k_cos2));
+    cr = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(cr, z), z), _mm256_mul_ps(_mm256_set1_ps(0.5f), z)), _mm256_set1_ps(1.f));
+
+    const __m256i one  = _mm256_set1_epi32(1);
+    const __m256i two  = _mm256_set1_epi32(2);
+    const __m256  swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(n, one), one));
+    const __m256  sv   = _mm256_blendv_ps(sr, cr, swap);
+    const __m256  cv   = _mm256_blendv_ps(cr, sr, swap);
+    const __m256  sSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(n, two), 30));
+    const __m256  cSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(n, one), two), 30));
+    s.v = _mm256_xor_ps(sv, sSign);
+    c.v = _mm256_xor_ps(cv, cSign);
+}
+
+#endif // SIMD_X64 && __AVX2__
+
+// True when the CPU and OS support AVX2 (QuatTracks.cpp).
+bool hasAvx2();
+
+} // namespace simd
@@ -0,0 +1,101 @@
+//
+// ThreadPool.cpp
+// ConstraintBasedMotionEdit
+//
+// Worker loop and block scheduling for ThreadPool.
+//
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int numThreads) {
+    if (numThreads <= 0) numThreads = (int)std::thread::hardware_concurrency();
+    numThreads = std::max(numThreads, 1);
+
+    // The calling thread counts as one participant
+    for (int i = 1; i < numThreads; i++)
+        m_workers.emplace_back([this] { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    for (auto& t : m_workers) t.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_cv.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_quit || !m_tasks.empty(); });
+            if (m_quit && m_tasks.empty()) return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& fn) {
+    if (count <= 0) return;
+    grain = std::max(grain, 1);
+
+    const int numBlocks = std::min((count + grain - 1) / grain, size() * 4);
+    if (numBlocks <= 1 || m_workers.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    // Shared state outlives this call in case a helper wakes up late
+    struct State {
+        std::atomic<int>        next{0};
+        std::atomic<int>        done{0};
+        std::mutex              mutex;
+        std::condition_variable cv;
+    };
+    auto state = std::make_shared<State>();
+
+    auto runBlocks = [state, numBlocks, count, &fn]() {
+        for (;;) {
+            int b = state->next.fetch_add(1);
+            if (b >= numBlocks) return;
+            int begin = (int)((long long)count * b / numBlocks);
+            int end   = (int)((long long)count * (b + 1) / numBlocks);
+            fn(begin, end);
+            if (state->done.fetch_add(1) + 1 == numBlocks) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+
+    const int helpers = std::min((int)m_workers.size(), numBlocks - 1);
+    for (int i = 0; i < helpers; i++) {
+        // Helpers only touch fn while blocks remain, i.e. before we return
+        enqueue([state, runBlocks] { runBlocks(); });
+    }
+    runBlocks();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->done.load() == numBlocks; });
+}
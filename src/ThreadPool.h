@@ -0,0 +1,49 @@
+//
+// ThreadPool.h
+// ConstraintBasedMotionEdit
+//
+// Fixed-size worker pool with a blocking parallelFor over index ranges.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // numThreads <= 0 uses std::thread::hardware_concurrency().
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&)            = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that take part in parallelFor (workers + caller).
+    int size() const { return (int)m_workers.size() + 1; }
+
+    // Splits [0, count) into contiguous blocks of at least 'grain' indices and
+    // calls fn(begin, end) for each block. The caller works on blocks too and
+    // returns once every block has finished. Block boundaries depend only on
+    // count, grain and size(), so results are deterministic.
+    void parallelFor(int count, int grain, const std::function<void(int, int)>& fn);
+
+    // Queues a fire-and-forget task.
+    void enqueue(std::function<void()> task);
+
+    // Process-wide pool shared by loaders, FK and batch tools.
+    static ThreadPool& shared();
+
+private:
+    std::vector<std::thread>          m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cv;
+    bool                              m_quit = false;
+
+    void workerLoop();
+};
@@ -0,0 +1,243 @@
+//
+// batch.cpp
+// ConstraintBasedMotionEdit
+//
+// MotionBatch: headless constraint-based editing of many BVH clips.
+// Every clip gets the same constraint set; clips are pulled from a shared
+// counter by all threads of ThreadPool::shared(), so long and short clips
+// balance out. Each clip is loaded, IK-constrained, B-spline fitted and
+// written as <stem>_edited.bvh.
+//
+//   MotionBatch -c constraints.txt [-o outdir] clip.bvh ... [@list.txt ...]
+//   MotionBatch bench-euler [joints] [frames]      (see BatchBench.h)
+//   MotionBatch bench-fk [frames] [joints ...]
+//   MotionBatch bench-ik [solves] [joints ...]
+//   MotionBatch check-ik-alloc [joints ...]
+//
+// constraints.txt: one "frame joint x y z" per line, '#' starts a comment.
+// frame < 0 counts from the end of each clip (-1 = last frame); joint is the
+// BVH joint index in file order; x y z is a world position in BVH units.
+// Constraints on the same frame are solved together (multi-effector IK).
+// "first:last joint x y z" holds the joint there on every frame of the range
+// (applyConstraintRange), e.g. a foot plant; the root (joint 0) cannot be held.
+//
+
+#include "BatchBench.h"
+#include "BVH.h"
+#include "MotionEdit.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Same pose scale as the viewer; the IK tolerances are tuned for it
+static constexpr float k_scale = 5.f;
+
+static void printUsage() {
+    std::cout << "usage: MotionBatch -c constraints.txt [-o outdir] clip.bvh ... [@list.txt ...]\n"
+                 "  constraints.txt  lines of \"frame joint x y z\" (BVH units, frame < 0 from the end)\n"
+                 "                   or \"first:last joint x y z\" to hold a joint over a frame range\n"
+                 "  @list.txt        file with one .bvh path per line\n"
+                 "  -o outdir        output directory (default: next to each clip)\n"
+                 "   or: MotionBatch bench-euler [joints=200] [frames=1000000]\n"
+                 "   or: MotionBatch bench-fk [frames=10000] [joints=31 200 ...]\n"
+                 "   or: MotionBatch bench-ik [solves=10000] [joints=31 200 ...]\n"
+                 "   or: MotionBatch check-ik-alloc [joints=31 200 ...]\n";
+}
+
+static bool readConstraints(const char* path, std::vector<EditConstraint>& out) {
+    std::ifstream file(fs::u8path(path));
+    if (!file) {
+        std::cerr << "[batch] Cannot open: " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    for (int lineNo = 1; std::getline(file, line); lineNo++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        EditConstraint c;
+        if (!(in >> c.frame)) continue;   // blank or comment
+        c.last = c.frame;
+        if (in.peek() == ':') {
+            in.get();
+            in >> c.last;
+        }
+        if (!(in >> c.joint >> c.target.x >> c.target.y >> c.target.z) || c.joint < 0) {
+            std::cerr << "[batch] " << path << ":" << lineNo << ": expected \"frame[:last] joint x y z\"\n";
+            return false;
+        }
+        // IK only rotates the root's descendants, so nothing can move the
+        // root itself to a target
+        if (c.last != c.frame && c.joint == 0) {
+            std::cerr << "[batch] " << path << ":" << lineNo << ": the root (joint 0) cannot be held over a range, skipped\n";
+            continue;
+        }
+        out.push_back(c);
+    }
+    return true;
+}
+
+static void readList(const char* path, std::vector<std::string>& clips) {
+    std::ifstream file(fs::u8path(path));
+    if (!file) {
+        std::cerr << "[batch] Cannot open: " << path << "\n";
+        return;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if (!line.empty() && line[0] != '#') clips.push_back(line);
+    }
+}
+
+struct ClipResult {
+    bool ok      = false;
+    int  frames  = 0;
+    int  applied = 0;   // constraints that landed inside the clip
+};
+
+static ClipResult editClip(const std::string& path, const std::string& outDir,
+                           const std::vector<EditConstraint>& constraints, std::string& error) {
+    ClipResult result;
+
+    // Clips are the unit of parallelism; keep each load single-threaded and
+    // leave no .bvhc sidecars behind
+    BVHLoadOptions options;
+    options.parallel = false;
+    options.useCache = false;
+    options.verbose  = false;
+
+    BVH bvh;
+    bvh.Load(path.c_str(), options);
+    if (!bvh.is_load_success || bvh.num_frame == 0) {
+        error = "load failed";
+        return result;
+    }
+    result.frames = bvh.num_frame;
+
+    MotionClip edited;
+    buildClip(bvh, k_scale, edited);
+
+    // Ranges first; constraints on one frame are then solved together, with
+    // the ranges that cover the frame so they keep holding there
+    const int numLinks = edited.numLinks();
+    auto frameOf = [&](int f) { return f < 0 ? bvh.num_frame + f : f; };
+    std::vector<const EditConstraint*>     ranges;
+    std::map<int, std::vector<IKEffector>> byFrame;
+    for (const auto& c : constraints) {
+        const int f = frameOf(c.frame), last = frameOf(c.last);
+        if (c.joint >= numLinks || last < 0 || f >= bvh.num_frame || f > last) continue;
+        if (c.last != c.frame) {
+            applyConstraintRange(edited, c.joint, f, last, c.target * k_scale, IKOptions(), false);
+            ranges.push_back(&c);
+        }
+        else {
+            byFrame[f].push_back({ c.joint, c.target * k_scale });
+        }
+        result.applied++;
+    }
+    for (auto& frame : byFrame) {
+        for (const EditConstraint* r : ranges)
+            if (frameOf(r->frame) <= frame.first && frame.first <= frameOf(r->last))
+                frame.second.push_back({ r->joint, r->target * k_scale });
+        applyConstraints(Body(edited, frame.first), frame.second);
+    }
+    motionEdit(edited);
+
+    fs::path out = fs::u8path(path);
+    if (!outDir.empty()) out = fs::u8path(outDir) / out.filename();
+    out.replace_filename(out.stem().u8string() + "_edited.bvh");
+    if (!bvh.Save(out.u8string().c_str(), edited, k_scale, false)) {
+        error = "write failed";
+        return result;
+    }
+
+    result.ok = true;
+    return result;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "bench-euler") return benchEuler(argc - 2, argv + 2);
+    if (argc > 1 && std::string(argv[1]) == "bench-fk")    return benchFK(argc - 2, argv + 2);
+    if (argc > 1 && std::string(argv[1]) == "bench-ik")    return benchIK(argc - 2, argv + 2);
+    if (argc > 1 && std::string(argv[1]) == "check-ik-alloc") return checkIKAlloc(argc - 2, argv + 2);
+
+    std::vector<std::string> clips;
+    std::string consPath, outDir;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if      (arg == "-c" && i + 1 < argc) consPath = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) outDir   = argv[++i];
+        else if (arg == "-h" || arg == "--help") { printUsage(); return 0; }
+        else if (arg[0] == '@')               readList(arg.c_str() + 1, clips);
+        else                                  clips.push_back(arg);
+    }
+    if (consPath.empty() || clips.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<EditConstraint> constraints;
+    if (!readConstraints(consPath.c_str(), constraints)) return 1;
+    if (constraints.empty()) {
+        std::cerr << "[batch] No constraints in " << consPath << "\n";
+        return 1;
+    }
+
+    if (!outDir.empty()) {
+        std::error_code ec;
+        fs::create_directories(fs::u8path(outDir), ec);
+        if (ec) {
+            std::cerr << "[batch] Cannot create " << outDir << ": " << ec.message() << "\n";
+            return 1;
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto t0 = Clock::now();
+
+    ThreadPool&           pool = ThreadPool::shared();
+    std::atomic<int>      next{0};
+    std::atomic<int>      numOk{0}, numFailed{0}, numApplied{0};
+    std::atomic<long long> numFrames{0};
+    std::mutex            logMutex;
+    const int             numClips = (int)clips.size();
+
+    std::cout << "[batch] " << numClips << " clip(s), " << constraints.size()
+              << " constraint(s), " << pool.size() << " thread(s)\n";
+
+    // One block per thread; each pulls clips until none are left
+    pool.parallelFor(pool.size(), 1, [&](int, int) {
+        for (int i; (i = next.fetch_add(1)) < numClips;) {
+            std::string error;
+            ClipResult r = editClip(clips[i], outDir, constraints, error);
+            numFrames += r.frames;
+            numApplied += r.applied;
+            if (r.ok) {
+                numOk++;
+                continue;
+            }
+            numFailed++;
+            std::lock_guard<std::mutex> lock(logMutex);
+            std::cerr << "[batch] " << clips[i] << ": " << error << "\n";
+        }
+    });
+
+    double seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+    std::cout << "[batch] Done: " << numOk << " written, " << numFailed << " failed, "
+              << numApplied << " constraint(s) applied, " << numFrames << " frames in "
+              << seconds << " s (" << (seconds > 0 ? numClips / seconds : 0.0) << " clips/s)\n";
+    return numFailed > 0 ? 2 : 0;
+}
@@ -3,10 +3,8 @@
 // ConstraintBasedMotionEdit
 //
 // GLFW window, input callbacks, animation loop, and motion editing entry point.
-// Implements constraint-based motion retargeting via IK + cubic B-spline fitting.
-//
-// Reference: "Retargetting Motion to New Characters" — Gleicher et al.
-//            Cubic uniform B-spline: knot interval = 5 frames
+// Constraint-based motion retargeting via IK + cubic B-spline fitting lives
+// in MotionEdit.cpp.
 //
 
 #include <GL/glew.h>
@@ -18,34 +16,45 @@
 
 #include "IK.h"
 #include "BVH.h"
+#include "EditHistory.h"
+#include "MotionEdit.h"
 #include "Renderer.h"
 #include "ShaderUtils.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <filesystem>
 
 // ---------------------------------------------------------------------------
 // Constants
 // ---------------------------------------------------------------------------
 static constexpr int   WINDOW_W      = 800;
 static constexpr int   WINDOW_H      = 600;
-static constexpr int   k_jointCount  = 31;   // number of joints to hit-test
 static constexpr float k_pickRadius  = 1.5f; // world-space picking radius
 
+// Files at least this large are streamed: only a window of frames is decoded
+// and the clips hold only the displayed frame (editing is disabled).
+static constexpr uintmax_t k_streamBytes  = 512ull * 1024 * 1024;
+static constexpr int       k_streamWindow = 2048;  // decoded frames kept resident
+
 // ---------------------------------------------------------------------------
 // Global state
 // ---------------------------------------------------------------------------
 static Renderer         g_renderer;
 static BVH*             g_bvh      = nullptr;
-static std::vector<Body> g_newBody;
-static std::vector<Body> g_oldBody;
+static MotionClip       g_newClip;   // edit layer over the original motion
+static EditHistory      g_history;   // undo / redo of g_newClip (not while streaming)
 
 static int   g_totalFrame = 0;
 static int   g_frameNum   = 0;
 static float g_frameTime  = 0.f;
 static bool  g_animating  = false;
 static float g_lastTime   = 0.f;
+static bool  g_streaming  = false;   // g_newClip holds only the displayed frame
+static std::shared_ptr<MotionClip> g_streamOrigin;   // streaming: one-frame base of g_newClip
+static std::string g_bvhPath;
 
 static int       g_picked   = -1;
 static glm::vec2 g_oldPt2;
@@ -57,28 +66,63 @@ static float     g_oldDepth = 0.f;
 // ---------------------------------------------------------------------------
 // Simulation helpers
 // ---------------------------------------------------------------------------
+
+// Body of the displayed frame
+static Body curNewBody() { return Body(g_newClip, g_streaming ? 0 : g_frameNum); }
+
+// Re-poses the single-frame base from streamed frame f; the layer over it
+// has no edits, so only its cached transforms need refreshing.
+static void poseStreamFrame(int f) {
+    g_bvh->UpdatePose(f, Body(*g_streamOrigin, 0), 5);
+    g_newClip.invalidateFrames(0, 1);
+}
+
+static void setFrame(int f) {
+    g_frameNum = f;
+    // Non-streaming frames are read through the clip's world cache, so
+    // playing unedited frames runs no FK
+    if (g_streaming) {
+        poseStreamFrame(f);
+        g_bvh->Prefetch(f);
+    }
+}
+
 static void loadBVH(const std::string& path) {
-    g_newBody.clear();
-    g_oldBody.clear();
+    g_newClip.clear();
+    g_streamOrigin.reset();
+    g_history.clear();
     g_frameNum  = 0;
     g_frameTime = 0.f;
     g_bvh->Clear();
-    g_bvh->Load(path.c_str());
+    g_bvhPath = path;
+
+    BVHLoadOptions options;
+    std::error_code ec;
+    uintmax_t bytes = std::filesystem::file_size(std::filesystem::u8path(path), ec);
+    g_streaming = !ec && bytes >= k_streamBytes;
+    if (g_streaming) options.streamWindow = k_streamWindow;
+    g_bvh->Load(path.c_str(), options);
 
     g_totalFrame = g_bvh->num_frame;
-    Body temp;
-    for (int i = 0; i < g_totalFrame; i++) {
-        temp.clear();
-        g_bvh->UpdatePose(i, temp, 5);
-        g_newBody.push_back(temp);
-        g_oldBody.push_back(temp);
-
-        g_newBody[i].getDisplacement(g_newBody[i], g_newBody[i]);
-        g_oldBody[i].getDisplacement(g_oldBody[i], g_oldBody[i]);
-
-        g_oldBody[i].updatePos(0);
-        g_newBody[i].updatePos(0);
+    if (g_streaming) {
+        if (g_totalFrame > 0) {
+            // Clip and skeleton are built once; playback only re-poses them
+            g_streamOrigin = std::make_shared<MotionClip>();
+            g_streamOrigin->create(g_bvh->MakeSkeleton(5), 1);
+            g_newClip.createLayer(g_streamOrigin);
+            poseStreamFrame(0);
+        }
+        return;
     }
+
+    buildClip(*g_bvh, 5, g_newClip);
+
+    // Per-load heap use of the clip planes (original + edit layer)
+    const Arena::Stats& base  = g_newClip.base()->arenaStats();
+    const Arena::Stats& layer = g_newClip.arenaStats();
+    std::cout << "[clip] " << base.allocations + layer.allocations << " planes in "
+              << base.blocks + layer.blocks << " heap allocation(s), "
+              << (base.peakBytes + layer.peakBytes) / (1024.0 * 1024.0) << " MB peak\n";
 }
 
 static void init() {
@@ -86,80 +130,63 @@ static void init() {
     loadBVH("BVH/WalkStartA.bvh");
 }
 
+// Drops every edit; the original motion is shared, so nothing is reloaded.
+static void resetEdits() {
+    g_picked    = -1;
+    g_frameTime = 0.f;
+    if (g_newClip.empty()) {
+        init();
+        return;
+    }
+    if (!g_streaming) g_history.beginLayerEdit(g_newClip);
+    g_newClip.resetLayer();
+    if (!g_streaming) g_history.endLayerEdit(g_newClip, "reset");
+    setFrame(0);   // streaming: re-poses the frame without the edit
+}
+
 static void frame(float dt) {
     g_frameTime += dt;
     if (g_frameTime > 0.03f) {
-        g_frameNum  = (g_frameNum + 1) % g_bvh->num_frame;
         g_frameTime = 0.f;
-        g_newBody[g_frameNum].updatePos(0);
+        setFrame((g_frameNum + 1) % g_bvh->num_frame);
     }
 }
 
-// Cubic uniform B-spline constraint-based motion editing.
-// For each joint, fits a B-spline through the constrained displacement frames,
-// then applies the curve to all frames to produce smooth motion.
-static void motionEdit() {
-    std::vector<int> cons;
-    for (int i = 0; i < g_totalFrame; i++) {
-        if (g_newBody[i].constraint) {
-            cons.push_back(i);
-            g_newBody[i].constraint = false;
-        }
+// Applies every constraint dragged so far to the whole clip.
+static void applyMotionEdit() {
+    if (g_streaming) {
+        std::cout << "[motionEdit] Not available while streaming.\n";
+        return;
     }
-    if (cons.empty()) return;
-
-    const int   space    = 5;
-    const int   controlN = g_totalFrame / space + 1;
-
-    for (int joint = 1; joint < (int)g_bvh->joints.size() + 1; joint++) {
-        Eigen::MatrixXf basis = Eigen::MatrixXf::Zero(controlN, (int)cons.size());
-        Eigen::MatrixXf p     = Eigen::MatrixXf::Zero(3, (int)cons.size());
-
-        for (int j = 0; j < (int)cons.size(); j++) {
-            int   f = cons[j];
-            float t = (f % space) / (float)space;
-            int   k = f / space;
-
-            // Skip boundary cases where B-spline stencil is incomplete
-            if (k < 1 || k > controlN - 4) continue;
 
-            // Cubic uniform B-spline basis (de Boor)
-            basis(k - 1, j) = (1.f/6.f) * (1-t)*(1-t)*(1-t);
-            basis(k,     j) = (1.f/6.f) * (3*t*t*t - 6*t*t + 4);
-            basis(k + 1, j) = (1.f/6.f) * (-3*t*t*t + 3*t*t + 3*t + 1);
-            basis(k + 2, j) = (1.f/6.f) * t*t*t;
+    g_history.beginLayerEdit(g_newClip);
+    int count = motionEdit(g_newClip);
+    g_history.endLayerEdit(g_newClip, "motion edit");
+    if (count > 0)
+        std::cout << "[motionEdit] Done. " << count << " constraint(s) applied.\n";
+}
 
-            p(0, j) = g_newBody[f].displacement(joint, 0);
-            p(1, j) = g_newBody[f].displacement(joint, 1);
-            p(2, j) = g_newBody[f].displacement(joint, 2);
-        }
+// Steps the edit history back (undo) or forward (redo).
+static void stepHistory(bool redo) {
+    if (g_streaming || g_newClip.empty()) return;
+    g_picked = -1;
+    if (redo ? g_history.redo(g_newClip) : g_history.undo(g_newClip))
+        std::cout << "[history] " << (redo ? "Redo: " : "Undo: ")
+                  << (redo ? g_history.undoName() : g_history.redoName()) << "\n";
+}
 
-        // Solve for B-spline control points via SVD pseudo-inverse: b = p * B^+
-        auto solver = basis.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV);
-        solver.setThreshold(0.01f);
-        Eigen::MatrixXf b = p * solver.solve(Eigen::MatrixXf::Identity(controlN, controlN));
-
-        // Apply B-spline curve to all frames
-        for (int f = 0; f < g_totalFrame; f++) {
-            float t = (f % space) / (float)space;
-            int   k = f / space;
-            if (k < 1 || k > controlN - 3) continue;
-
-            glm::vec3 bspline =
-                glm::vec3(b(0, k-1), b(1, k-1), b(2, k-1)) * (1.f/6.f) * (1-t)*(1-t)*(1-t) +
-                glm::vec3(b(0, k  ), b(1, k  ), b(2, k  )) * (1.f/6.f) * (3*t*t*t - 6*t*t + 4) +
-                glm::vec3(b(0, k+1), b(1, k+1), b(2, k+1)) * (1.f/6.f) * (-3*t*t*t + 3*t*t + 3*t + 1) +
-                glm::vec3(b(0, k+2), b(1, k+2), b(2, k+2)) * (1.f/6.f) * t*t*t;
-
-            glm::quat dq = glm::quat(1.f, bspline.x, bspline.y, bspline.z);
-            g_newBody[f].links[joint - 1].q = g_oldBody[f].links[joint - 1].q * dq;
-        }
+// Writes the edited clip next to the source as <name>_edited.bvh.
+static void exportBVH() {
+    if (g_streaming) {
+        std::cout << "[export] Not available while streaming.\n";
+        return;
     }
+    if (g_newClip.empty()) return;
 
-    for (int f = 0; f < g_totalFrame; f++)
-        g_newBody[f].updatePos(0);
-
-    std::cout << "[motionEdit] Done. " << cons.size() << " constraint(s) applied.\n";
+    std::filesystem::path out = std::filesystem::u8path(g_bvhPath);
+    out.replace_filename(out.stem().u8string() + "_edited.bvh");
+    if (g_bvh->Save(out.u8string().c_str(), g_newClip, 5))
+        std::cout << "[export] Saved: " << out.u8string() << "\n";
 }
 
 // ---------------------------------------------------------------------------
@@ -168,9 +195,14 @@ static void motionEdit() {
 static void renderScene() {
     if (!g_bvh || g_bvh->joints.empty()) return;
 
-    g_newBody[g_frameNum].render();
-    for (int i = 0; i < g_bvh->num_frame; i++)
-        g_newBody[i].shapeRender();
+    if (g_newClip.empty()) return;
+
+    // Trajectories read every frame: refresh whatever an edit dirtied in one
+    // pass (a no-op during plain playback)
+    g_newClip.updateWorld();
+    curNewBody().render();
+    for (int f = 0; f < g_newClip.numFrames(); f++)
+        Body(g_newClip, f).shapeRender();
 
     if (g_picked >= 0)
         drawSphere(g_targetPt, 1.5f, glm::vec4(1, 1, 0, .1f));
@@ -195,21 +227,28 @@ static void onMouseButton(GLFWwindow*, int button, int action, int) {
         g_oldPt3  = pt3;
         g_oldDepth = d;
 
-        // Hit-test joints
+        // Hit-test joints: the nearest one within the radius, so dense rigs
+        // (fingers, End Sites) pick what is under the cursor. Not while
+        // streaming: the next frame re-poses the clip and would drop the drag.
         g_picked = -1;
-        if (g_bvh && !g_newBody.empty()) {
-            for (int i = 0; i < k_jointCount; i++) {
-                if (glm::length(pt3 - g_newBody[g_frameNum].links[i].getPos()) < k_pickRadius) {
+        if (g_bvh && !g_newClip.empty() && !g_streaming) {
+            const Body body = curNewBody();
+            float nearest = k_pickRadius;
+            for (int i = 0; i < body.numLinks(); i++) {
+                const float d = glm::length(pt3 - body.getPos(i));
+                if (d < nearest) {
+                    nearest   = d;
                     g_picked  = i;
-                    g_pickPt  = g_newBody[g_frameNum].links[i].getPos();
+                    g_pickPt  = body.getPos(i);
                     g_targetPt = g_pickPt;
-                    break;
                 }
             }
+            if (g_picked >= 0) g_history.beginFrameEdit(g_newClip, g_frameNum);
         }
     }
     else if (action == GLFW_RELEASE) {
         g_picked = -1;
+        g_history.endFrameEdit(g_newClip);
     }
 }
 
@@ -218,19 +257,14 @@ static void onCursorPos(GLFWwindow*, double x, double y) {
 
     glm::vec2 pt2((float)x, (float)y);
 
-    if (g_picked >= 0 && glfwGetMouseButton(glfwGetCurrentContext(), GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+    if (g_picked >= 0 && !g_streaming &&
+        glfwGetMouseButton(glfwGetCurrentContext(), GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
         // IK drag
         g_targetPt = g_pickPt + g_renderer.unprojectAtDepth(pt2, g_oldDepth) - g_oldPt3;
-        g_newBody[g_frameNum].solveIK(g_picked, g_targetPt);
-
-        int condition = 0;
-        if      (g_picked > 0  && g_picked < 7)                                  condition = 1;
-        else if (g_picked >= 7 && g_picked < 13)                                 condition = 2;
-        else if (g_picked >= 13 && g_picked < (int)g_newBody[g_frameNum].links.size()) condition = 3;
-
-        g_newBody[g_frameNum].updatePos(condition);
-        g_newBody[g_frameNum].getDisplacement(g_oldBody[g_frameNum], g_newBody[g_frameNum]);
-        g_newBody[g_frameNum].constraint = true;
+        // Playback moved on mid-drag: the rest of the drag is a new step
+        if (g_history.editFrame() != g_frameNum)
+            g_history.beginFrameEdit(g_newClip, g_frameNum);
+        applyConstraint(curNewBody(), g_picked, g_targetPt);
     }
     else if (glfwGetMouseButton(glfwGetCurrentContext(), GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
         // Camera orbit
@@ -249,7 +283,7 @@ static void onScroll(GLFWwindow*, double, double yOffset) {
     g_renderer.m_dist *= std::pow(0.8f, (float)yOffset);
 }
 
-static void onKey(GLFWwindow*, int key, int, int action, int) {
+static void onKey(GLFWwindow*, int key, int, int action, int mods) {
     if (action != GLFW_PRESS) return;
     if (ImGui::GetIO().WantCaptureKeyboard) return;
 
@@ -260,10 +294,19 @@ static void onKey(GLFWwindow*, int key, int, int action, int) {
         break;
     case GLFW_KEY_0:
         g_animating = false;
-        init();
+        resetEdits();
         break;
     case GLFW_KEY_1:
-        motionEdit();
+        applyMotionEdit();
+        break;
+    case GLFW_KEY_2:
+        exportBVH();
+        break;
+    case GLFW_KEY_Z:
+        if (mods & GLFW_MOD_CONTROL) stepHistory((mods & GLFW_MOD_SHIFT) != 0);
+        break;
+    case GLFW_KEY_Y:
+        if (mods & GLFW_MOD_CONTROL) stepHistory(true);
         break;
     default:
         break;
@@ -334,16 +377,23 @@ int main() {
 
         // Info panel
         ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always);
-        ImGui::SetNextWindowSize(ImVec2(220, 130), ImGuiCond_Always);
+        ImGui::SetNextWindowSize(ImVec2(220, 212), ImGuiCond_Always);
         ImGui::Begin("Info", nullptr,
                      ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize |
                      ImGuiWindowFlags_NoCollapse);
         ImGui::Text("Frame: %d / %d", g_frameNum, g_totalFrame);
-        ImGui::Text("Animating: %s", g_animating ? "Yes" : "No");
+        int scrub = g_frameNum;
+        if (g_totalFrame > 0 && ImGui::SliderInt("##frame", &scrub, 0, g_totalFrame - 1))
+            setFrame(scrub);
+        ImGui::Text("Animating: %s%s", g_animating ? "Yes" : "No", g_streaming ? "  (streaming)" : "");
+        ImGui::Text("History: %d / %d (%.1f KB)", g_history.numUndo(),
+                    g_history.numUndo() + g_history.numRedo(), g_history.bytes() / 1024.0);
         ImGui::Separator();
         ImGui::Text("[Space]  Toggle animation");
         ImGui::Text("[0]      Reset");
         ImGui::Text("[1]      Apply motion edit");
+        ImGui::Text("[2]      Export edited .bvh");
+        ImGui::Text("[Ctrl+Z/Y] Undo / redo");
         ImGui::Text("Drag .bvh file to load");
         ImGui::End();
 